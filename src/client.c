@@ -65,7 +65,7 @@ int main(int argc, char** argv){
 
     //Command line arguments
 	while(!finished){
-		opt = getopt(argc, argv, "hf:w:W:D:r:R::d:t:l:u:c:pva:");
+		opt = getopt(argc, argv, "hf:w:W:D:r:R::d:t:l:u:c:pva:z");
 		switch(opt){
 			case 'h':{
 				printf(
@@ -106,7 +106,10 @@ int main(int argc, char** argv){
 						"  -p, -v\t\tPrints info about each operation.\n\n"
 						"  -c file1[,file2...]\tDeletes the files specified (separated by a ',')\n"
 						"\t\t\tfrom the server.\n\n"
-						"  -a file1,file2\tAppends the contents of file2 to file1.\n", basename(argv[0]));
+						"  -a file1,file2\tAppends the contents of file2 to file1.\n\n"
+						"  -z\t\t\tCompresses the files sent to the server, and\n"
+						"\t\t\treceives the files as the server stores them,\n"
+						"\t\t\tdecompressing them locally.\n", basename(argv[0]));
 				finished = true;
 				queueFree(commandQueue);
 				return 0;
@@ -221,6 +224,10 @@ int main(int argc, char** argv){
 				queuePush(&commandQueue, (void*)cmd);
 				break;
 			}
+			case 'z':{
+				compressedTransfers = true;
+				break;
+			}
 			case '?':{
 				fprintf(stderr, "Unrecognized option: %c\n", optopt);
 				finished = true;
@@ -11,6 +11,8 @@
 
 
 
+//Set before openConnection to negotiate compressed transfers: the files are sent compressed and received as they're stored
+extern bool compressedTransfers;
 extern bool verbose;
 
 
@@ -0,0 +1,54 @@
+#ifndef SOL_PROJECT_CODEC_H
+#define SOL_PROJECT_CODEC_H
+
+#include <stddef.h>
+
+#include "defines.h"
+
+#define CODEC_LEVEL_SEPARATOR ':'
+
+
+
+//Codecs the contents of the files can be compressed with, used as indexes in the codec registry
+typedef enum CompressionAlgorithm{
+    Uncompressed,
+    Miniz,
+    LZ,
+    CompressionAlgorithmCount
+} CompressionAlgorithm;
+
+//Receives the data decompressed by the streaming decompressors, a chunk at a time and in order. The chunk is only valid until
+//it returns. Returns false to stop decompressing
+typedef bool (*CodecOutput)(const char* chunk, size_t size, void* argument);
+
+//Compression format, with the functions to compress and decompress whole buffers in it. The level trades compression ratio
+//for speed, higher levels compress more. Codecs have no state, so their functions can be called concurrently from any thread
+typedef struct Codec{
+    const char* name; //Name the codec is selected by in the configuration file
+    int minLevel;
+    int maxLevel;
+    int defaultLevel;
+    size_t (*bound)(size_t size); //Largest size a buffer of size bytes can be compressed to
+    size_t (*compress)(const char* data, size_t size, char* out, size_t capacity, int level); //Returns the compressed size, 0 on error
+    bool (*decompress)(const char* data, size_t size, char* out, size_t outSize); //outSize has to be the exact uncompressed size
+    //Same as above, with a preset dictionary the data can refer to as if it preceded it. The output isn't compatible with
+    //the one of the functions without dictionary, and the same dictionary has to be passed to decompress it. Codecs that
+    //can speed up compression by preparing a state from the dictionary once have prepareDictionary, which returns NULL on
+    //error, and need its result to be passed to compressWithDictionary. The others ignore it
+    void* (*prepareDictionary)(const char* dictionary, size_t dictionarySize, int level);
+    void (*freePreparedDictionary)(void* prepared);
+    size_t (*compressWithDictionary)(const char* dictionary, size_t dictionarySize, const void* prepared, const char* data, size_t size, char* out, size_t capacity, int level);
+    bool (*decompressWithDictionary)(const char* dictionary, size_t dictionarySize, const char* data, size_t size, char* out, size_t outSize);
+    //Decompresses data compressed by either compress or, if dictionary isn't NULL, compressWithDictionary, in a window of
+    //fixed size instead of a buffer as big as the uncompressed data, passing the data to output as the window fills up.
+    //Returns false on error or if output does, after passing part of the data to output if the error is found late
+    bool (*decompressStream)(const char* dictionary, size_t dictionarySize, const char* data, size_t size, size_t outSize, CodecOutput output, void* argument);
+} Codec;
+
+
+
+const Codec* getCodec(CompressionAlgorithm algorithm);
+
+bool parseCodec(const char* specification, CompressionAlgorithm* algorithm, int* level);
+
+#endif //SOL_PROJECT_CODEC_H
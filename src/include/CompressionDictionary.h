@@ -0,0 +1,36 @@
+#ifndef SOL_PROJECT_COMPRESSIONDICTIONARY_H
+#define SOL_PROJECT_COMPRESSIONDICTIONARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "defines.h"
+
+#define COMPRESSION_DICTIONARY_DMER_SIZE 8
+#define COMPRESSION_DICTIONARY_HASH_BITS 18
+#define COMPRESSION_DICTIONARY_SEGMENT_SIZE 64
+
+
+
+//Preset dictionary, data that small buffers are compressed as if it preceded them, so that they can refer to the strings
+//that are common among the files of the cache instead of starting from an empty window. Immutable and reference counted:
+//the data compressed with a dictionary keeps it alive, so that a dictionary replaced by a newer one is freed once no data
+//compressed with it is left
+typedef struct CompressionDictionary{
+    unsigned int id; //Incremented at every training, to tell the dictionaries apart in the logs
+    unsigned int references;
+    void* prepared; //State prepared from the dictionary by the codec it's used with, NULL if there's none
+    void (*freePrepared)(void* prepared);
+    size_t size;
+    char data[];
+} CompressionDictionary;
+
+
+
+void acquireCompressionDictionary(CompressionDictionary* dictionary);
+
+void releaseCompressionDictionary(CompressionDictionary* dictionary);
+
+CompressionDictionary* trainCompressionDictionary(const char* samples, const size_t* sampleSizes, unsigned int sampleCount, size_t capacity, unsigned int id);
+
+#endif //SOL_PROJECT_COMPRESSIONDICTIONARY_H
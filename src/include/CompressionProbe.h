@@ -0,0 +1,27 @@
+#ifndef SOL_PROJECT_COMPRESSIONPROBE_H
+#define SOL_PROJECT_COMPRESSIONPROBE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "defines.h"
+
+#define COMPRESSION_PROBE_MIN_SIZE 4096
+#define COMPRESSION_PROBE_WINDOWS 4
+#define COMPRESSION_PROBE_WINDOW_SIZE 1024
+#define COMPRESSION_PROBE_ENTROPY_FACTOR 181 //2^7.5, samples over 7.5 bits of entropy per byte aren't worth compressing
+
+
+
+//Outcome of the check done before compressing a buffer
+typedef enum CompressionProbeResult{
+    ProbeCompressible,
+    ProbeKnownFormat, //Starts with the signature of a format that is compressed already, like JPEG or ZIP
+    ProbeHighEntropy //The bytes sampled are close to random, so compression wouldn't shrink them
+} CompressionProbeResult;
+
+
+
+CompressionProbeResult probeCompressibility(const char* data, size_t size);
+
+#endif //SOL_PROJECT_COMPRESSIONPROBE_H
@@ -0,0 +1,36 @@
+#ifndef SOL_PROJECT_CONTENTALLOCATOR_H
+#define SOL_PROJECT_CONTENTALLOCATOR_H
+
+#include <stddef.h>
+
+#include "defines.h"
+
+#define CONTENT_ALLOCATOR_HUGE_PAGE_SIZE 2097152
+#define CONTENT_ALLOCATOR_LARGE_SIZE 65536
+
+
+
+//Allocator of the buffers holding the contents of the files. Buffers up to CONTENT_ALLOCATOR_LARGE_SIZE bytes are allocated
+//with malloc, larger buffers are mapped on their own, and unmapped as soon as they are released, so that the memory of large
+//files is given back to the system when they're removed. The size a buffer is released with has to be the one it has been
+//allocated with. Buffers can be allocated and released concurrently from any thread
+typedef struct ContentAllocator{
+    size_t pageSize;
+    bool hugePages; //Whether mapped buffers bigger than a huge page are advised to use transparent huge pages
+    size_t mappedBytes; //Updated atomically
+    size_t heapBytes; //Bytes allocated with malloc, updated atomically
+} ContentAllocator;
+
+
+
+char* contentAllocatorAllocate(ContentAllocator* allocator, size_t size);
+
+void contentAllocatorFree(ContentAllocator** allocator);
+
+ContentAllocator* contentAllocatorInit(bool hugePages);
+
+void contentAllocatorRelease(ContentAllocator* allocator, char* buffer, size_t size);
+
+size_t contentAllocatorReservedBytes(ContentAllocator* allocator);
+
+#endif //SOL_PROJECT_CONTENTALLOCATOR_H
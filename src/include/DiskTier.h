@@ -0,0 +1,89 @@
+#ifndef SOL_PROJECT_DISKTIER_H
+#define SOL_PROJECT_DISKTIER_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "defines.h"
+#include "FileCache.h"
+#include "HashIndex.h"
+
+#define DISK_TIER_INDEX_CAPACITY 256
+#define DISK_TIER_MIN_SEGMENTS 8
+#define DISK_TIER_SEGMENT_SIZE (16 * 1024 * 1024)
+
+
+
+struct DiskTierSegment;
+
+//Location of a file written to the tier. The records of a segment are linked together, so that they can be dropped with it
+typedef struct DiskTierRecord{
+    struct DiskTierSegment* segment; //NULL while the file is being taken, see diskTierTake
+    off_t offset; //Of the first frame of the file in the segment
+    size_t length; //Bytes of the record in the segment, header and name included
+    size_t size; //Bytes of the frames, without their headers, which is the size the file is stored in once restored
+    size_t uncompressedSize;
+    unsigned int frameCount;
+    struct DiskTierRecord* prev;
+    struct DiskTierRecord* next;
+    char filename[];
+} DiskTierRecord;
+
+//File of the log, written only at its end until it reaches the segment size of the tier, then never written again
+typedef struct DiskTierSegment{
+    unsigned int number; //The file is named after it, segment-<number>.log
+    int fd;
+    size_t size;
+    unsigned int liveRecords;
+    DiskTierRecord* records;
+} DiskTierSegment;
+
+typedef struct DiskTierStatistics{
+    unsigned int filesWritten;
+    unsigned int filesPromoted; //Read back into the cache
+    unsigned int filesDropped; //Lost because their segment was reclaimed to stay within the capacity
+    unsigned int segmentsReclaimed;
+    unsigned long bytesWritten;
+    unsigned long bytesRead;
+} DiskTierStatistics;
+
+//Second tier of the cache, where the files evicted from memory are kept until they're requested again. The files are appended
+//to a log split in segments, as they're stored in the cache: their segments are written as frames, see streamFileFrames, so
+//the compressed ones aren't decompressed and compressed again on the way. Files read back or overwritten leave dead bytes
+//in their segment, which is deleted once it holds no file. When the log outgrows the capacity, its oldest segment is deleted
+//with the files still in it, so the tier behaves as a FIFO cache. An index in memory maps the names of the files to their
+//records, so the files are read with a single seek. The log only lasts as long as the server, it's emptied at startup.
+//The index and the segments are guarded by the lock of the tier, which isn't held while a file is read back
+typedef struct DiskTier{
+    pthread_mutex_t lock;
+    pthread_cond_t takeEnded; //Signaled when a file stops being taken, for the requests waiting for it
+    char* directory;
+    size_t capacity;
+    size_t segmentSize;
+    size_t size; //Bytes of all the segments, dead ones included
+    HashIndex index;
+    DiskTierSegment** segments; //From the oldest, the last one is the one being written
+    unsigned int segmentCount;
+    unsigned int segmentCapacity;
+    unsigned int nextSegment;
+    DiskTierStatistics stats;
+} DiskTier;
+
+
+
+bool diskTierContains(DiskTier* tier, const char* filename, size_t* size);
+
+bool diskTierEndTake(DiskTier* tier, const char* filename, FileContents* contents);
+
+bool diskTierPut(DiskTier* tier, const char* filename, FileContents* contents);
+
+bool diskTierRemove(DiskTier* tier, const char* filename);
+
+FileContents* diskTierTake(DiskTier* tier, FileCache* fileCache, const char* filename, size_t* size);
+
+void freeDiskTier(DiskTier** tier);
+
+DiskTier* initDiskTier(const char* directory, size_t capacity);
+
+#endif //SOL_PROJECT_DISKTIER_H
@@ -0,0 +1,57 @@
+#ifndef SOL_PROJECT_EPOCH_H
+#define SOL_PROJECT_EPOCH_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "defines.h"
+
+#define EPOCH_CACHE_LINE_SIZE 64
+
+
+
+//Function freeing a retired pointer
+typedef void (*EpochDestructor)(void* pointer);
+
+//Epoch announced by a participant while it's inside a critical section, 0 while it's outside.
+//Padded to a cache line, so that participants entering and exiting don't invalidate each other's line
+typedef struct EpochParticipant{
+    unsigned long epoch;
+    char padding[EPOCH_CACHE_LINE_SIZE - sizeof(unsigned long)];
+} EpochParticipant;
+
+typedef struct RetiredPointer{
+    void* pointer;
+    EpochDestructor destructor;
+    unsigned long epoch; //Epoch in which the pointer was retired
+    struct RetiredPointer* next;
+} RetiredPointer;
+
+//Epoch based reclamation: participants read shared structures without locks between epochEnter and epochExit, while
+//the objects unlinked from those structures are retired instead of being freed. A retired object is only freed once every
+//participant that could still hold a reference to it, having entered before it was retired, has exited
+typedef struct EpochDomain{
+    unsigned long epoch; //Incremented by every retirement
+    EpochParticipant* participants;
+    unsigned int participantCount;
+    RetiredPointer* oldestRetired; //Retired pointers not yet freed, in increasing epoch order
+    RetiredPointer* newestRetired;
+    unsigned int retiredCount;
+    pthread_mutex_t retiredLock;
+} EpochDomain;
+
+
+
+void epochCollect(EpochDomain* domain);
+
+void epochEnter(EpochDomain* domain, unsigned int participant);
+
+void epochExit(EpochDomain* domain, unsigned int participant);
+
+void epochFree(EpochDomain** domain);
+
+EpochDomain* epochInit(unsigned int participantCount);
+
+void epochRetire(EpochDomain* domain, void* pointer, EpochDestructor destructor);
+
+#endif //SOL_PROJECT_EPOCH_H
@@ -6,35 +6,143 @@
 #include <string.h>
 
 #include "defines.h"
+#include "Codec.h"
+#include "CompressionDictionary.h"
+#include "CompressionProbe.h"
+#include "ContentAllocator.h"
+#include "Epoch.h"
 #include "FileCachingProtocol.h"
+#include "FrequencySketch.h"
+#include "HashIndex.h"
+#include "Slab.h"
 
 #define MAX_FILENAME_SIZE FCP_MESSAGE_LENGTH - 5
+#define FILE_INDEX_INITIAL_CAPACITY 1024
+#define FILE_CACHE_DEFAULT_SHARDS 16
+#define FILE_RECORD_SIZE_CLASSES 4
+#define FILE_SEGMENT_COMPACTION_SIZE 65536
+#define FILE_SEGMENT_STREAMING_SIZE 65536
+#define FILE_UPLOAD_CHUNK_SIZE FCP_UPLOAD_FRAME_SIZE //The same, so that the frames of a client fill the blocks of an upload
+#define FILE_SEGMENTS_BEFORE_COMPACTION 8
+#define FILE_HOT_HEAT 16
+#define FILE_COLD_HEAT 4
+#define FILE_HOT_BUDGET_PERCENT 90
+#define FILE_BLOB_KEY_SIZE 17
+#define FILE_BLOB_INITIAL_CAPACITY 256
+#define FILE_DICTIONARY_MAX_SEGMENT_SIZE 8192
+#define FILE_DICTIONARY_SIZE 32768
+#define FILE_DICTIONARY_SAMPLES_SIZE 1048576
+#define FILE_DICTIONARY_MAX_SAMPLES 4096
+#define FILE_DICTIONARY_RETRAINING_SEGMENTS 16384
 
+//Index of the segments stored by storeFile, by the hash of their data, so that files written with the same contents share
+//a single segment. Segments are removed from it when their last reference is dropped
+typedef struct BlobTable{
+	pthread_mutex_t lock; //Guards index, held only for lookups, insertions and removals
+	HashIndex index;
+	unsigned int hits; //Segments shared instead of being stored again
+} BlobTable;
 
-typedef enum CompressionAlgorithm{
-    Uncompressed,
-    Miniz
-} CompressionAlgorithm;
+//Preset dictionary small segments are compressed with, trained on a sample of the small segments compressed before it.
+//A new dictionary is trained every FILE_DICTIONARY_RETRAINING_SEGMENTS segments, so that it follows the files stored,
+//while the segments compressed with the previous ones keep them alive
+typedef struct DictionaryTrainer{
+	pthread_mutex_t lock; //Guards all the fields, isn't held while training
+	CompressionDictionary* current; //NULL until the first dictionary has been trained
+	char* samples; //FILE_DICTIONARY_SAMPLES_SIZE bytes, the samples collected are stored one after the other
+	size_t samplesSize;
+	size_t sampleSizes[FILE_DICTIONARY_MAX_SAMPLES];
+	unsigned int sampleCount;
+	unsigned int segmentsSinceTraining; //Segments compressed with the current dictionary
+	bool training; //Set while a thread is training the next dictionary, no samples are collected meanwhile
+	unsigned int trained; //Dictionaries trained, the next one takes it as id
+} DictionaryTrainer;
 
+//Part of the contents of a file, compressed independently from the others, so that appending to a file only has to compress
+//the data appended. Immutable and reference counted, since the contents built by an append share the segments already stored
+typedef struct FileSegment{
+	char* data; //Allocated for size bytes from allocator
+	size_t size;
+	size_t uncompressedSize;
+	CompressionAlgorithm compression;
+	CompressionDictionary* dictionary; //Dictionary the data has been compressed with, NULL if none
+	bool compressionPending; //Stored as received, compressFile hasn't tried to compress it yet
+	unsigned int references;
+	unsigned int owners; //Contents installed in files that include the segment, the storage used counts it while it has any
+	ContentAllocator* allocator;
+	BlobTable* blobs; //Table the segment has been indexed in, NULL if it hasn't
+	char blobKey[FILE_BLOB_KEY_SIZE]; //Hash of the uncompressed data, in hexadecimal, if the segment has been indexed
+} FileSegment;
+
+//Immutable contents of a file, as the sequence of its segments, shared by the cache and by the readers that pinned them to send
+//them without holding any lock. Writers replace the contents of a file instead of modifying them, the old contents are freed
+//when their last reader unpins them
+typedef struct FileContents{
+	size_t size; //Sum of the stored sizes of the segments
+	size_t uncompressedSize;
+	unsigned int references;
+	unsigned int smallSegments; //Segments smaller than FILE_SEGMENT_COMPACTION_SIZE, that compaction would merge
+	unsigned int segmentCount;
+	size_t* offsets; //Uncompressed offset of the first byte of each segment, the index streamFileRange finds ranges with
+	FileSegment* segments[];
+} FileContents;
+
+//Files are allocated from the slabs of their shard, in a single record together with their node in the file list and their name
 typedef struct CachedFile{
-	char* filename;
-	char* contents;
+	char* filename; //Stored in the record of the file
+	FileContents* contents; //NULL for empty files and for the files detached from the cache
+	FileContents* evictedContents; //Contents of a file evicted by detachFilesToEvict, pinned until the eviction sink is done with them
 	size_t size;
 	size_t uncompressedSize;
 	int lockedBy;
-	pthread_mutex_t* lock;
-	CompressionAlgorithm compression;
-    uint64_t lastAccessed;
+	size_t reservedSize; //Storage reserved by the client that locked the file for the data it's sending, see reserveFileCapacity
+	pthread_mutex_t lock;
+	CompressionAlgorithm compression; //Codec of the compressed segments, Uncompressed if none is compressed
+	bool detached; //Set, with the lock of the file held, once the file has been removed from the cache
+	unsigned int heat; //Reads, halved at every tiering pass
+	bool hot; //Kept uncompressed, so that reads don't have to decompress it
+	struct RecencyList* recencyList; //Recency list the file is in, used by the LRU and ARC algorithms
+	struct CachedFile* lessRecent;
+	struct CachedFile* moreRecent;
+	unsigned int frequency; //Number of accesses, used by the GDSF algorithm
+	double priority; //GDSF priority, files with the lowest priority are evicted first
+	size_t heapIndex; //Position of the file in the GDSF heap
+	size_t clockIndex; //Position of the file in the CLOCK ring
+	unsigned char referenced; //CLOCK reference bit, set by readers without taking any lock
 } CachedFile;
 
+typedef struct RecencyList{
+	CachedFile* mostRecent;
+	CachedFile* leastRecent;
+	unsigned int length;
+} RecencyList;
+
+//Name of a file recently evicted by ARC, remembered to detect that the file is being brought back into the cache
+typedef struct GhostEntry{
+	char* filename;
+	struct GhostList* list;
+	struct GhostEntry* lessRecent;
+	struct GhostEntry* moreRecent;
+} GhostEntry;
+
+typedef struct GhostList{
+	GhostEntry* mostRecent;
+	GhostEntry* leastRecent;
+	unsigned int length;
+} GhostList;
+
 typedef struct FileList{
 	CachedFile* file;
 	struct FileList* next;
+	struct FileList* prev;
 } FileList;
 
 typedef enum CacheAlgorithm{
 	FIFO,
-    LRU
+    LRU,
+    ARC,
+    GDSF,
+    CLOCK
 } CacheAlgorithm;
 
 typedef struct FileCacheStatistics{
@@ -43,46 +151,142 @@ typedef struct FileCacheStatistics{
 	
 } FileCacheStatistics;
 
+//Outcomes of the attempts at compressing the segments of the files, updated atomically
+typedef struct CompressionStatistics{
+	unsigned int compressed;
+	unsigned int compressedWithDictionary; //Counted in compressed too
+	unsigned int notShrunk; //Compressed, but stored uncompressed since they didn't shrink
+	unsigned int skippedByFormat; //Not compressed, since they start with the signature of a compressed format
+	unsigned int skippedByEntropy; //Not compressed, since the entropy of a sample of them is too high
+	unsigned int receivedCompressed; //Compressed by the clients, stored as they were received
+} CompressionStatistics;
+
+//Part of the files of the cache, selected by the hash of their filename, so that requests on files in different shards
+//don't contend for the same lock
+typedef struct FileCacheShard{
+	pthread_rwlock_t lock; //Guards files, has to be held for writing to add and remove files. Not needed to look files up
+	FileList* files;
+	HashIndex index; //Maps filenames to their node in files, read without locks
+	Slab records[FILE_RECORD_SIZE_CLASSES]; //Records of the files, by the length of the filename they can hold
+} FileCacheShard;
+
 typedef struct FileCache{
 	FileCacheStatistics max;
-	FileCacheStatistics current;
+	FileCacheStatistics current; //Updated atomically, since files in different shards can be added and removed concurrently
+	unsigned long logicalSize; //Sum of the sizes of the files, counting the segments they share once for each of them
 	FileCacheStatistics maxReached;
-	FileList* files;
+	FileCacheShard* shards;
+	unsigned int shardCount;
 	CacheAlgorithm cacheAlgorithm;
+	RecencyList recent; //Files ordered by insertion for FIFO, by last access for LRU, files accessed once (T1) for ARC
+	RecencyList frequent; //Files accessed more than once (T2) for ARC
+	GhostList recentGhosts; //Names evicted from recent (B1) and from frequent (B2) for ARC
+	GhostList frequentGhosts;
+	HashIndex ghostIndex;
+	unsigned int arcTarget; //Number of files ARC is currently aiming to keep in recent
+	CachedFile** gdsfHeap; //Min-heap of the files ordered by GDSF priority
+	size_t gdsfHeapLength;
+	size_t gdsfHeapCapacity;
+	double gdsfInflation; //Priority of the last file evicted by GDSF, added to new priorities to age the files already cached
+	CachedFile** clockRing; //Files in insertion order, swept circularly by the CLOCK hand
+	size_t clockLength;
+	size_t clockCapacity;
+	size_t clockHand;
+	pthread_mutex_t recencyLock; //Guards the recency and ghost lists, the GDSF heap and the CLOCK ring, is never held while waiting for a shard lock
+	FrequencySketch* admissionSketch; //Access frequencies used by the admission filter, NULL if the filter is disabled
 	unsigned int filesEvicted;
-	CompressionAlgorithm compressionAlgorithm;
+	unsigned int filesRejected; //New files refused by the admission filter
+	CompressionStatistics compressionStats;
+	ContentAllocator* contentAllocator; //Allocates the contents of the files
+	EpochDomain* epoch; //Frees the files removed from the cache once no reader can still be using them, NULL if there are no concurrent readers
+	CompressionAlgorithm compressionAlgorithm; //Codec new data is compressed with
+	int compressionLevel;
+	BlobTable* blobs; //Segments that can be shared by files with the same contents, NULL if deduplication is disabled
+	DictionaryTrainer* dictionaries; //NULL if small segments are compressed without dictionary
 } FileCache;
 
 
 
+bool admitFile(FileCache* fileCache, const char* filename);
+
+char* allocateFileData(FileCache* fileCache, size_t size);
+
+size_t appendToCachedFile(FileCache* fileCache, CachedFile* file, char* data, size_t size);
+
+FileContents* beginFileRestore(unsigned int segmentCount);
+
+FileContents* beginFileUpload(size_t size);
+
 bool canFitNewData(FileCache* fileCache, const char* filename, size_t dataSize, bool append);
 
 bool canFitNewFile(FileCache* fileCache);
 
+bool compactFile(FileCache* fileCache, CachedFile* file);
+
+bool compressFile(FileCache* fileCache, CachedFile* file);
+
 CachedFile* createFile(FileCache* fileCache, const char* filename);
 
+bool decompressFile(FileCache* fileCache, CachedFile* file);
+
+FileList* detachFilesToEvict(FileCache* fileCache, const char* fileToExclude, size_t bytesNeeded, unsigned int filesNeeded);
+
 bool fileExists(FileCache* fileCache, const char* filename);
 
+bool fileNeedsCompaction(CachedFile* file);
+
+bool fileNeedsCompression(CachedFile* file);
+
 void freeCachedFile(CachedFile* file);
 
 void freeFileCache(FileCache** fileCache);
 
+void freeFileList(FileList** fileList);
+
+const char* getCacheAlgorithmName(CacheAlgorithm cacheAlgorithm);
+
 size_t getUncompressedSize(CachedFile* file);
 
 CachedFile* getFile(FileCache* fileCache, const char* filename);
 
-CachedFile* getFileLockedByClient(FileCache* fileCache, int clientFd);
-
 size_t getFileSize(CachedFile* file);
 
-const char* getFileToEvict(FileCache* fileCache, const char* fileToExclude);
+FileCache* initFileCache(unsigned int maxFiles, unsigned long maxSize, CompressionAlgorithm compressionAlgorithm, int compressionLevel, CacheAlgorithm cacheAlgorithm, bool admissionFilter, unsigned int shardCount, unsigned int readers, bool hugePages, bool deduplication, bool dictionaries);
+
+FileContents* pinFileContents(FileCache* fileCache, CachedFile* file);
+
+const char* readFileSegment(FileSegment* segment, char** buffer, size_t* size);
+
+void recordFileAccess(FileCache* fileCache, const char* filename);
 
-FileCache* initFileCache(unsigned int maxFiles, unsigned long maxSize, CompressionAlgorithm compressionAlgorithm, CacheAlgorithm cacheAlgorithm);
+void releaseFileCapacity(FileCache* fileCache, CachedFile* file);
 
-char* readCachedFile(CachedFile* file, char** buffer, size_t* size);
+void releaseFileData(FileCache* fileCache, char* data, size_t size);
 
 void removeFileFromCache(FileCache* fileCache, const char* filename);
 
+bool reserveFileCapacity(FileCache* fileCache, CachedFile* file, size_t size);
+
+CachedFile* restoreFile(FileCache* fileCache, const char* filename, FileContents* contents);
+
+void retireFileList(FileCache* fileCache, FileList** fileList);
+
 size_t storeFile(FileCache* fileCache, CachedFile* file, char* contents, size_t size);
 
+size_t storeFileUpload(FileCache* fileCache, CachedFile* file, FileContents* upload, bool append);
+
+bool streamFileFrames(FileContents* contents, int32_t codecs, CodecOutput output, void* argument);
+
+bool streamFileRange(FileContents* contents, size_t offset, size_t size, CodecOutput output, void* argument);
+
+bool streamFileSegment(FileSegment* segment, CodecOutput output, void* argument);
+
+void unpinFileContents(FileContents* contents);
+
+unsigned int updateFileTemperatures(FileCache* fileCache, void (*onTemperatureChange)(const char* filename));
+
+bool uploadFileChunk(FileCache* fileCache, FileContents* upload, unsigned int index, char* chunk, size_t size);
+
+bool uploadFileFrame(FileCache* fileCache, FileContents* upload, unsigned int index, char* data, size_t size, size_t uncompressedSize, CompressionAlgorithm compression);
+
 #endif //SOL_PROJECT_FILECACHE_H
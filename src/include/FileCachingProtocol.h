@@ -12,6 +12,14 @@
 #define O_LOCK 2
 #define FCP_OPEN_FLAG_ISSET(flags, flagToCheck) \
 	(((flags) | (flagToCheck)) == (flags))
+//Compressed transfers, negotiated by FCP_HELLO: the client sends the codecs it can decode as a bitmask of CompressionAlgorithm
+//values, the server acks with the codec and level the client has to compress the files it sends with
+#define FCP_CODEC_BIT(algorithm) (1 << (algorithm))
+#define FCP_UPLOAD_CODEC(algorithm, level) (((level) << 8) | (algorithm))
+#define FCP_UPLOAD_CODEC_ALGORITHM(control) ((control) & 0xFF)
+#define FCP_UPLOAD_CODEC_LEVEL(control) ((control) >> 8)
+#define FCP_UPLOAD_FRAME_SIZE 1048576 //Uncompressed bytes in each frame sent by the client, but the last one
+#define FCP_MIN_COMPRESSED_FRAME_SIZE 8192 //Frames up to this size are sent uncompressed, so that the server can compress them with its dictionary
 
 
 
@@ -42,6 +50,7 @@ typedef struct OpenFilesList{
 typedef struct ClientList{
 	int descriptor;
 	ConnectionStatus status;
+	int32_t codecs; //Codecs negotiated by FCP_HELLO, as FCP_CODEC_BITs. 0 if the client transfers files uncompressed
 	OpenFilesList* openFiles;
 	struct ClientList* next;
 } ClientList;
@@ -57,7 +66,8 @@ typedef enum FCPOpcode{
 	FCP_CLOSE,
 	FCP_REMOVE,
 	FCP_ACK,
-	FCP_ERROR
+	FCP_ERROR,
+	FCP_HELLO
 } FCPOpcode;
 
 #pragma pack(1)
@@ -68,16 +78,28 @@ typedef struct FCPMessage{
 	char op;
 	char filename[FCP_MAX_FILENAME_SIZE];
 } FCPMessage;
+
+//Once compressed transfers have been negotiated, the contents of the files are sent in frames, each made of this header followed
+//by size bytes of data, until the uncompressed size announced by the message that precedes them is reached
+typedef struct FCPFrameHeader{
+	uint32_t size;
+	uint32_t uncompressedSize;
+	char compression; //CompressionAlgorithm the data is compressed with, Uncompressed if it's sent as it is
+} FCPFrameHeader;
 #pragma pack() //Resetting default packing settings
 
 
 
 void clientListAdd(ClientList** list, int descriptor);
 
+int32_t clientListGetCodecs(ClientList* list, int descriptor);
+
 ConnectionStatus clientListGetStatus(ClientList* list, int descriptor);
 
 void clientListRemove(ClientList** list, int descriptor);
 
+void clientListSetCodecs(ClientList* list, int descriptor, int32_t codecs);
+
 void clientListUpdateStatus(ClientList* list, int descriptor, ConnectionStatus status);
 
 void closeAllFiles(ClientList* list, int descriptor);
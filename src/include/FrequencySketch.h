@@ -0,0 +1,37 @@
+#ifndef SOL_PROJECT_FREQUENCYSKETCH_H
+#define SOL_PROJECT_FREQUENCYSKETCH_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "defines.h"
+
+#define FREQUENCY_SKETCH_DEPTH 4
+#define FREQUENCY_SKETCH_MAX_COUNT 15
+#define FREQUENCY_SKETCH_MIN_WIDTH 64
+
+
+
+//Count-min sketch estimating how many times each key has been seen, in constant space.
+//All the counters are halved every sampleSize increments, so that the estimates follow recent popularity.
+//Increments and estimates can be done concurrently from any thread without external locking
+typedef struct FrequencySketch{
+    uint8_t* counters; //FREQUENCY_SKETCH_DEPTH rows of width counters each
+    size_t width;
+    unsigned int sampleSize;
+    unsigned int additions;
+    pthread_mutex_t agingLock;
+} FrequencySketch;
+
+
+
+unsigned int frequencySketchEstimate(FrequencySketch* sketch, const char* key);
+
+void frequencySketchFree(FrequencySketch** sketch);
+
+void frequencySketchIncrement(FrequencySketch* sketch, const char* key);
+
+FrequencySketch* frequencySketchInit(size_t expectedKeys);
+
+#endif //SOL_PROJECT_FREQUENCYSKETCH_H
@@ -0,0 +1,54 @@
+#ifndef SOL_PROJECT_HASHINDEX_H
+#define SOL_PROJECT_HASHINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "defines.h"
+#include "Epoch.h"
+
+#define HASH_INDEX_MIN_CAPACITY 16
+
+
+
+//Returns the key a value is indexed by. The key has to stay valid for as long as the value is in the index
+typedef const char* (*HashIndexKeyFunction)(const void* value);
+
+typedef struct HashIndexSlot{
+    uint32_t hash;
+    void* value;
+} HashIndexSlot;
+
+typedef struct HashIndexTable{
+    size_t capacity;
+    HashIndexSlot slots[];
+} HashIndexTable;
+
+//Open addressing hash table with linear probing, mapping string keys to values.
+//The keys are not copied, they are read from the values through the key function.
+//Insertions and removals have to be serialized by the caller, while lookups can run concurrently with them without locks,
+//as long as the values removed are not freed while a lookup might still be reading them. With an epoch domain, the tables
+//replaced when the index grows are retired to it, so that lookups can be done from inside its critical sections
+typedef struct HashIndex{
+    HashIndexTable* table;
+    size_t count;
+    size_t tombstones;
+    HashIndexKeyFunction getKey;
+    EpochDomain* epoch;
+} HashIndex;
+
+
+
+void hashIndexFree(HashIndex* index);
+
+void* hashIndexGet(HashIndex* index, const char* key);
+
+bool hashIndexInit(HashIndex* index, size_t capacity, HashIndexKeyFunction getKey, EpochDomain* epoch);
+
+bool hashIndexInsert(HashIndex* index, void* value);
+
+void* hashIndexRemove(HashIndex* index, const char* key);
+
+uint32_t hashString(const char* key);
+
+#endif //SOL_PROJECT_HASHINDEX_H
@@ -0,0 +1,44 @@
+#ifndef SOL_PROJECT_LZ_H
+#define SOL_PROJECT_LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Codec.h"
+#include "defines.h"
+
+#define LZ_HASH_BITS 16
+#define LZ_LAST_LITERALS 5
+#define LZ_MAX_LEVEL 9
+#define LZ_MIN_HASH_BITS 10
+#define LZ_MIN_MATCH 4
+#define LZ_STREAM_BUFFER_SIZE (2 * LZ_WINDOW_SIZE)
+#define LZ_WILD_COPY_SIZE 16
+#define LZ_WINDOW_SIZE 65536
+
+
+
+//Byte oriented LZ77 codec, trading compression ratio for speed: there's no entropy coding, so decompressing is mostly copying.
+//A compressed buffer is a sequence of literal runs, each followed by a match with the data already decompressed, LZ_WINDOW_SIZE
+//bytes back at most. Every sequence starts with a token, whose high nibble is the length of the literals and whose low
+//nibble is the length of the match minus LZ_MIN_MATCH. A nibble of 15 is followed by bytes adding to it, up to the first
+//byte under 255. The literals follow, then the offset of the match on 2 bytes, little endian, then the bytes adding to its length.
+//The last sequence has no match, and its literals end the buffer.
+//Level 1 only looks at the last position with the same hash, higher levels follow a chain of up to 2^(level - 1) positions.
+//With a dictionary, the offsets can reach back into it as if it preceded the data
+
+
+
+size_t lzBound(size_t size);
+
+size_t lzCompress(const char* data, size_t size, char* out, size_t capacity, int level);
+
+size_t lzCompressWithDictionary(const char* dictionary, size_t dictionarySize, const void* prepared, const char* data, size_t size, char* out, size_t capacity, int level);
+
+bool lzDecompress(const char* data, size_t size, char* out, size_t outSize);
+
+bool lzDecompressStream(const char* dictionary, size_t dictionarySize, const char* data, size_t size, size_t outSize, CodecOutput output, void* argument);
+
+bool lzDecompressWithDictionary(const char* dictionary, size_t dictionarySize, const char* data, size_t size, char* out, size_t outSize);
+
+#endif //SOL_PROJECT_LZ_H
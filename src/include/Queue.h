@@ -20,4 +20,6 @@ void* queuePop(Queue** queue);
 
 void queuePush(Queue** queue, void* data);
 
+void* queueRemoveIf(Queue** queue, bool (*match)(void* data, void* argument), void* argument);
+
 #endif //SOL_PROJECT_QUEUE_H
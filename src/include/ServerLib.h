@@ -8,19 +8,37 @@
 #include <pthread.h>
 #include <sys/select.h>
 
+#include "../include/DiskTier.h"
 #include "../include/FileCache.h"
 #include "../include/Queue.h"
 
 
 
+//Where the files evicted from the cache end up
+typedef enum EvictionSink{
+    ReturnToClient, //Sent to the client whose request caused the eviction
+    Discard,
+    Spill, //Written to spillDirectory
+    Tier //Appended to diskTier, from where they're restored when they're opened again
+} EvictionSink;
+
+//Destination of the chunks of file contents written by serverWriteFileContents
+typedef struct FileContentsWriter{
+    int fd;
+    ssize_t bytesWritten;
+} FileContentsWriter;
+
+
 extern ClientList* clientList;
 extern pthread_rwlock_t clientListLock;
 extern unsigned int clientsConnected;
+extern DiskTier* diskTier;
+extern EvictionSink evictionSink;
 extern FileCache* fileCache;
-extern pthread_rwlock_t fileCacheLock;
 extern pthread_mutex_t incomingConnectionsLock;
 extern pthread_cond_t incomingConnectionsCond;
 extern int logPipeDescriptors[2];
+extern char* spillDirectory;
 extern bool workersShouldTerminate;
 
 
@@ -31,6 +49,8 @@ void closeAllClientDescriptors();
 
 bool fileExistsL(const char* filename);
 
+int32_t getClientCodecsL(int descriptor);
+
 int getClientWaitingForLockL(const char* filename);
 
 CachedFile* getFileL(const char* filename);
@@ -57,20 +77,24 @@ void pthread_rwlock_wrlock_error(pthread_rwlock_t* lock, const char* msg);
 
 void removeFromFdSetUpdatingMax(int fd, fd_set* fdSet, int* maxFd);
 
+FileList* serverDetachVictims(const char* fileToExclude, size_t bytesNeeded, unsigned int filesNeeded, const char* operation, int workerID);
+
 void serverDisconnectClientL(int clientFd, bool lockClientList);
 
-int serverEvictFile(const char* fileToExclude, const char* operation, int fdToServe, int workerID);
+void serverDisposeEvictedFiles(FileList* victims, int fdToServe, int workerID);
 
 bool serverLockFileL(int workerID, int fdToServe, const char* filename, CachedFile *file, bool sendAck);
 
 void serverLog(const char* format, ...);
 
-void serverRemoveFile(const char* filename, int workerID);
-
 void serverRemoveFileL(const char* filename, int workerID);
 
 void serverSignalFileUnlockL(CachedFile* file, int workerID, int desc);
 
+ssize_t serverWriteFileContents(FileContents* contents, int fd, int32_t codecs);
+
+void setClientCodecsL(int32_t codecs, int fdToServe);
+
 void terminateServer(short *running);
 
 void unlockAllFilesLockedByClient(FileCache* fileCache, int clientFd);
@@ -0,0 +1,41 @@
+#ifndef SOL_PROJECT_SLAB_H
+#define SOL_PROJECT_SLAB_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "defines.h"
+
+#define SLAB_CACHE_LINE_SIZE 64
+#define SLAB_RECORDS_PER_CHUNK 64
+
+
+
+//Block of memory holding SLAB_RECORDS_PER_CHUNK records, which start at the first cache line after the header
+typedef struct SlabChunk{
+    struct SlabChunk* next;
+} SlabChunk;
+
+//Allocator of records all of the same size, carved out of cache line aligned chunks and recycled through a free list,
+//so that objects created and destroyed often don't go through malloc each time and don't share cache lines with each other.
+//Chunks are never returned to the system while the slab is in use, they are all freed at once by slabFree.
+//Allocations and releases can be done concurrently from any thread
+typedef struct Slab{
+    size_t recordSize; //Rounded up to a multiple of the cache line size
+    void* freeRecords; //Released records, linked through their first word
+    SlabChunk* chunks;
+    size_t recordsInUse;
+    pthread_mutex_t lock;
+} Slab;
+
+
+
+void* slabAllocate(Slab* slab);
+
+void slabFree(Slab* slab);
+
+bool slabInit(Slab* slab, size_t recordSize);
+
+void slabRelease(Slab* slab, void* record);
+
+#endif //SOL_PROJECT_SLAB_H
@@ -10,6 +10,8 @@
 #include <unistd.h>
 
 #include "../include/ClientAPI.h"
+#include "../include/Codec.h"
+#include "../include/CompressionProbe.h"
 #include "../include/FileCachingProtocol.h"
 #include "../include/ion.h"
 #include "../include/ParseUtils.h"
@@ -26,24 +28,128 @@ extern char *realpath (const char *__restrict __name, char *__restrict __resolve
 //Open connections key value list, useful if the API is extended to handle more connections
 static ArgsList* openConnections = NULL;
 static int activeConnectionFD = -1;
+//Compressed transfers negotiated with the server of the active connection, and the codec the files sent are compressed with
+static bool framedTransfers = false;
+static CompressionAlgorithm uploadCompression = Uncompressed;
+static int uploadLevel = 0;
+bool compressedTransfers = false;
 bool verbose = false;
 
 
+//Asks the server for compressed transfers on a new connection, offering all the codecs the client has. If the server accepts,
+//sets *framed and stores the codec and level to compress the files sent with, otherwise the files are transferred uncompressed.
+//Returns false if the server doesn't reply as the protocol requires
+static bool negotiateCompressedTransfers(int fd, bool* framed, CompressionAlgorithm* compression, int* level){
+    int32_t codecs = 0;
+    for(int i = 0; i < CompressionAlgorithmCount; i++){
+        codecs |= FCP_CODEC_BIT(i);
+    }
+    printIfVerbose("Sending hello to server\n");
+    fcpSend(FCP_HELLO, codecs, NULL, fd);
+
+    char fcpBuffer[FCP_MESSAGE_LENGTH];
+    ssize_t bytesRead = readn(fd, fcpBuffer, FCP_MESSAGE_LENGTH);
+    FCPMessage* message = fcpMessageFromBuffer(fcpBuffer);
+    bool valid = bytesRead == FCP_MESSAGE_LENGTH;
+    if(valid && message->op == FCP_ACK){
+        *compression = FCP_UPLOAD_CODEC_ALGORITHM(message->control);
+        *level = FCP_UPLOAD_CODEC_LEVEL(message->control);
+        const Codec* codec = getCodec(*compression < CompressionAlgorithmCount ? *compression : Uncompressed);
+        valid = *compression < CompressionAlgorithmCount && (*compression == Uncompressed || (*level >= codec->minLevel && *level <= codec->maxLevel));
+        if(valid){
+            *framed = true;
+            printIfVerbose("Compressed transfers enabled, sending files compressed with codec \"%s\"\n", codec->name);
+        }
+    }else if(valid && message->op == FCP_ERROR){
+        printIfVerbose("Server refused compressed transfers\n");
+    }else{
+        valid = false;
+    }
+    free(message);
+    return valid;
+}
+
+//Reads the contents of a file sent by the server, size bytes once uncompressed, in a buffer of that size. With compressed
+//transfers they're received as frames, each decompressed as soon as it's read. Returns false if the server sends less data than
+//announced or violates the protocol
+static bool receiveFileContents(char* buffer, size_t size){
+    if(!framedTransfers){
+        return readn(activeConnectionFD, buffer, size) == size;
+    }
+    size_t received = 0;
+    while(received < size){
+        FCPFrameHeader header;
+        if(readn(activeConnectionFD, (char*)&header, sizeof(FCPFrameHeader)) != sizeof(FCPFrameHeader)){
+            return false;
+        }
+        unsigned char compression = header.compression;
+        if(header.uncompressedSize == 0 || header.uncompressedSize > size - received || compression >= CompressionAlgorithmCount){
+            return false;
+        }
+        if(compression == Uncompressed){
+            if(header.size != header.uncompressedSize || readn(activeConnectionFD, buffer + received, header.size) != header.size){
+                return false;
+            }
+        }else{
+            const Codec* codec = getCodec(compression);
+            char* frame = header.size <= codec->bound(header.uncompressedSize) ? malloc(header.size) : NULL;
+            bool decompressed = frame != NULL && readn(activeConnectionFD, frame, header.size) == header.size && codec->decompress(frame, header.size, buffer + received, header.uncompressedSize);
+            free(frame);
+            if(!decompressed){
+                return false;
+            }
+        }
+        received += header.uncompressedSize;
+    }
+    return true;
+}
+
+//Sends the contents of a file to the server. With compressed transfers they're sent as frames of FCP_UPLOAD_FRAME_SIZE bytes,
+//each compressed with the codec the server asked for, unless it's small or it wouldn't shrink, in which case it's sent as it is.
+//Returns false if there's an error
+static bool sendFileContents(const char* data, size_t size){
+    if(!framedTransfers){
+        return writen(activeConnectionFD, (char*)data, size) == size;
+    }
+    const Codec* codec = getCodec(uploadCompression);
+    size_t capacity = uploadCompression == Uncompressed ? 0 : codec->bound(FCP_UPLOAD_FRAME_SIZE);
+    char* compressed = capacity == 0 ? NULL : malloc(capacity);
+    if(capacity != 0 && compressed == NULL){
+        return false;
+    }
+    bool sent = true;
+    for(size_t offset = 0; sent && offset < size; offset += FCP_UPLOAD_FRAME_SIZE){
+        size_t frameSize = size - offset < FCP_UPLOAD_FRAME_SIZE ? size - offset : FCP_UPLOAD_FRAME_SIZE;
+        size_t compressedSize = 0;
+        if(compressed != NULL && frameSize > FCP_MIN_COMPRESSED_FRAME_SIZE && probeCompressibility(data + offset, frameSize) == ProbeCompressible){
+            compressedSize = codec->compress(data + offset, frameSize, compressed, capacity, uploadLevel);
+        }
+        bool shrunk = compressedSize > 0 && compressedSize < frameSize;
+        FCPFrameHeader header;
+        header.size = shrunk ? compressedSize : frameSize;
+        header.uncompressedSize = frameSize;
+        header.compression = shrunk ? uploadCompression : Uncompressed;
+        sent = writen(activeConnectionFD, (char*)&header, sizeof(FCPFrameHeader)) == sizeof(FCPFrameHeader) && writen(activeConnectionFD, shrunk ? compressed : (char*)data + offset, header.size) == header.size;
+    }
+    free(compressed);
+    return sent;
+}
+
 //Utility function called by functions that have to save a file if the server sends one back,
 //such as openFile2, readNFiles and writeOrAppendFile
 static int receiveAndSaveFileFromServer(size_t filesize, const char* filename, const char* dirname){
     printIfVerbose("Receiving file from server (filename: \"%s\", bytes: %zu)\n", filename, filesize);
     size_t size = filesize;
     char* fileBuffer = malloc(size);
-    ssize_t fileSize = readn(activeConnectionFD, fileBuffer, size);
-    printIfVerbose("Received file from server, (%ld bytes)\n", fileSize);
-
-    if(size != fileSize){
+    if(!receiveFileContents(fileBuffer, size)){
         //The server has sent a message of size different from what it specified previously with the FCP_WRITE message.
         //This violates the protocol
+        free(fileBuffer);
         errno = EPROTO;
         return -1;
     }
+    ssize_t fileSize = size;
+    printIfVerbose("Received file from server, (%ld bytes)\n", fileSize);
 
     if(dirname != NULL){
         //Directory specified, the file has to be saved
@@ -124,14 +230,20 @@ static int writeOrAppendFile(const char* pathname, void* buf, size_t size, const
                         //Sending file to server
                         receivingCacheMissFiles = false;
                         printIfVerbose("Server has sent ack back, starting transfer\n");
+                        bool sent = false;
                         if(append){
-                            writen(activeConnectionFD, buf, size);
+                            sent = sendFileContents(buf, size);
                         }else{
                             char *fileBuffer = malloc(size);
                             readn(fileDescriptor, fileBuffer, size);
-                            writen(activeConnectionFD, fileBuffer, size);
+                            sent = sendFileContents(fileBuffer, size);
                             free(fileBuffer);
                         }
+                        if(!sent){
+                            //Couldn't send the file, errno has been set by the function that failed
+                            success = false;
+                            break;
+                        }
                         printIfVerbose("File transfer complete, waiting for ack\n");
                         //Getting confirmation from the server
                         if(readn(activeConnectionFD, fcpBuffer, FCP_MESSAGE_LENGTH) == FCP_MESSAGE_LENGTH){
@@ -372,6 +484,16 @@ int openConnection(const char* sockname, int msec, const struct timespec abstime
 		}
 	}while(compareTimes(deadlineTime, currentTime) > 0);
 
+	bool framed = false;
+	CompressionAlgorithm compression = Uncompressed;
+	int level = 0;
+	if(connectionSucceeded && compressedTransfers && !negotiateCompressedTransfers(clientSocketDescriptor, &framed, &compression, &level)){
+		//The server doesn't understand the handshake
+		close(clientSocketDescriptor);
+		errno = EPROTO;
+		return -1;
+	}
+
 	if(connectionSucceeded){
 		//Adding the connection to the key value array of open connections
 		ArgsList* newConnection = initArgsListNode();
@@ -384,6 +506,9 @@ int openConnection(const char* sockname, int msec, const struct timespec abstime
 		openConnections = newConnection;
 
 		activeConnectionFD = clientSocketDescriptor;
+		framedTransfers = framed;
+		uploadCompression = compression;
+		uploadLevel = level;
 		return 0;
 	}else{
         //Couldn't connect to the server
@@ -508,7 +633,13 @@ int readFile(const char* pathname, void** buf, size_t* size){
 					*size = message->control;
 					fcpSend(FCP_ACK, 0, NULL, activeConnectionFD);
 					*buf = malloc(*size);
-					readn(activeConnectionFD, *buf, *size);
+					if(!receiveFileContents(*buf, *size)){
+						//The server has sent less data than announced
+						free(*buf);
+						*buf = NULL;
+						success = false;
+						errno = EPROTO;
+					}
 					break;
 				}
 				case FCP_ERROR:{
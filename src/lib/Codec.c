@@ -0,0 +1,182 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../include/Codec.h"
+#include "../include/LZ.h"
+#include "../include/miniz.h"
+
+
+
+static size_t minizBound(size_t size){
+    return compressBound(size);
+}
+
+static size_t minizCompress(const char* data, size_t size, char* out, size_t capacity, int level){
+    unsigned long compressedSize = capacity;
+    if(compress2((unsigned char*)out, &compressedSize, (const unsigned char*)data, size, level) != Z_OK){
+        return 0;
+    }
+    return compressedSize;
+}
+
+static bool minizDecompress(const char* data, size_t size, char* out, size_t outSize){
+    unsigned long decompressedSize = outSize;
+    return uncompress((unsigned char*)out, &decompressedSize, (const unsigned char*)data, size) == Z_OK && decompressedSize == outSize;
+}
+
+//miniz doesn't implement the preset dictionaries of zlib. The data is compressed as a raw deflate stream instead, by a
+//compressor that has already compressed the dictionary and has been flushed to a byte boundary: the output of the dictionary
+//is dropped, while the dictionary stays in the window for the data to refer to. Since compressing the dictionary takes much
+//longer than compressing a small file, the primed compressor is kept, and copied for every file. The level is the one of the
+//primed compressor, the one passed to minizCompressWithDictionary is ignored
+static void* minizPrepareDictionary(const char* dictionary, size_t dictionarySize, int level){
+    tdefl_compressor* out = malloc(sizeof(tdefl_compressor));
+    size_t dictionaryCapacity = compressBound(dictionarySize);
+    char* dictionaryOut = malloc(dictionaryCapacity);
+    bool primed = false;
+    if(out != NULL && dictionaryOut != NULL && tdefl_init(out, NULL, NULL, tdefl_create_comp_flags_from_zip_params(level, -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY)) == TDEFL_STATUS_OKAY){
+        size_t inSize = dictionarySize;
+        size_t outSize = dictionaryCapacity;
+        primed = tdefl_compress(out, dictionary, &inSize, dictionaryOut, &outSize, TDEFL_SYNC_FLUSH) == TDEFL_STATUS_OKAY && inSize == dictionarySize;
+    }
+    free(dictionaryOut);
+    if(!primed){
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+
+static void minizFreePreparedDictionary(void* prepared){
+    free(prepared);
+}
+
+static size_t minizCompressWithDictionary(const char* dictionary, size_t dictionarySize, const void* prepared, const char* data, size_t size, char* out, size_t capacity, int level){
+    const tdefl_compressor* primed = prepared;
+    tdefl_compressor* compressor = malloc(sizeof(tdefl_compressor));
+    if(primed == NULL || compressor == NULL){
+        free(compressor);
+        return 0;
+    }
+    //The code and output buffers are empty after a flush, so only the state before them and the hash chains are copied.
+    //The pointers into the buffers are moved to the ones of the copy
+    memcpy(compressor, primed, offsetof(tdefl_compressor, m_lz_code_buf));
+    memcpy(compressor->m_next, primed->m_next, offsetof(tdefl_compressor, m_output_buf) - offsetof(tdefl_compressor, m_next));
+    compressor->m_pLZ_code_buf = compressor->m_lz_code_buf + (primed->m_pLZ_code_buf - primed->m_lz_code_buf);
+    compressor->m_pLZ_flags = compressor->m_lz_code_buf + (primed->m_pLZ_flags - primed->m_lz_code_buf);
+    compressor->m_pOutput_buf = compressor->m_output_buf;
+    compressor->m_pOutput_buf_end = compressor->m_output_buf;
+    size_t inSize = size;
+    size_t outSize = capacity;
+    bool compressed = tdefl_compress(compressor, data, &inSize, out, &outSize, TDEFL_FINISH) == TDEFL_STATUS_DONE;
+    free(compressor);
+    return compressed ? outSize : 0;
+}
+
+//The data is decompressed after a copy of the dictionary, so that its back references can reach into it
+static bool minizDecompressWithDictionary(const char* dictionary, size_t dictionarySize, const char* data, size_t size, char* out, size_t outSize){
+    tinfl_decompressor* decompressor = malloc(sizeof(tinfl_decompressor));
+    char* buffer = malloc(dictionarySize + outSize);
+    bool decompressed = false;
+    if(decompressor != NULL && buffer != NULL){
+        memcpy(buffer, dictionary, dictionarySize);
+        tinfl_init(decompressor);
+        size_t inSize = size;
+        size_t written = outSize;
+        tinfl_status status = tinfl_decompress(decompressor, (const mz_uint8*)data, &inSize, (mz_uint8*)buffer, (mz_uint8*)buffer + dictionarySize, &written, TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
+        decompressed = status == TINFL_STATUS_DONE && written == outSize;
+        if(decompressed){
+            memcpy(out, buffer + dictionarySize, outSize);
+        }
+    }
+    free(decompressor);
+    free(buffer);
+    return decompressed;
+}
+
+//The data is decompressed in a circular buffer of TINFL_LZ_DICT_SIZE bytes, the size of the deflate window, which is passed
+//to output each time it fills up. The dictionary, if any, is copied at the start of the buffer, and the data is decompressed
+//right after it, so that back references reach into it. tinfl only checks that back references don't go before the start
+//of the output with a non wrapping buffer, so the buffer is passed as such until it has been filled once: from then on, it
+//holds the whole window, and every distance deflate allows is valid. Since it's a raw deflate stream, the data compressed
+//with a dictionary has no zlib header
+static bool minizDecompressStream(const char* dictionary, size_t dictionarySize, const char* data, size_t size, size_t outSize, CodecOutput output, void* argument){
+    tinfl_decompressor* decompressor = malloc(sizeof(tinfl_decompressor));
+    mz_uint8* window = malloc(TINFL_LZ_DICT_SIZE);
+    bool decompressed = false;
+    if(decompressor != NULL && window != NULL){
+        size_t windowOffset = 0;
+        bool windowFilled = false;
+        if(dictionary != NULL){
+            size_t windowDictionarySize = dictionarySize < TINFL_LZ_DICT_SIZE ? dictionarySize : TINFL_LZ_DICT_SIZE;
+            memcpy(window, dictionary + dictionarySize - windowDictionarySize, windowDictionarySize);
+            windowFilled = windowDictionarySize == TINFL_LZ_DICT_SIZE;
+            windowOffset = windowDictionarySize & (TINFL_LZ_DICT_SIZE - 1);
+        }
+        tinfl_init(decompressor);
+        int flags = dictionary == NULL ? TINFL_FLAG_PARSE_ZLIB_HEADER : 0;
+        size_t inOffset = 0;
+        size_t remaining = outSize;
+        while(true){
+            size_t inSize = size - inOffset;
+            size_t written = TINFL_LZ_DICT_SIZE - windowOffset;
+            tinfl_status status = tinfl_decompress(decompressor, (const mz_uint8*)data + inOffset, &inSize, window, window + windowOffset, &written, flags | (windowFilled ? 0 : TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF));
+            inOffset += inSize;
+            if(written > remaining || (written > 0 && !output((const char*)window + windowOffset, written, argument))){
+                break;
+            }
+            remaining -= written;
+            if(status != TINFL_STATUS_HAS_MORE_OUTPUT){
+                decompressed = status == TINFL_STATUS_DONE && remaining == 0;
+                break;
+            }
+            //More output means the end of the buffer has been reached
+            windowFilled = true;
+            windowOffset = (windowOffset + written) & (TINFL_LZ_DICT_SIZE - 1);
+        }
+    }
+    free(decompressor);
+    free(window);
+    return decompressed;
+}
+
+//Codec registry, indexed by CompressionAlgorithm. Uncompressed has no functions, its data is stored as it is
+static const Codec codecs[CompressionAlgorithmCount] = {
+    [Uncompressed] = {"none", 0, 0, 0, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL},
+    [Miniz] = {"zlib", MZ_NO_COMPRESSION, MZ_UBER_COMPRESSION, MZ_DEFAULT_LEVEL, minizBound, minizCompress, minizDecompress, minizPrepareDictionary, minizFreePreparedDictionary, minizCompressWithDictionary, minizDecompressWithDictionary, minizDecompressStream},
+    [LZ] = {"lz", 1, LZ_MAX_LEVEL, 1, lzBound, lzCompress, lzDecompress, NULL, NULL, lzCompressWithDictionary, lzDecompressWithDictionary, lzDecompressStream}
+};
+
+
+
+const Codec* getCodec(CompressionAlgorithm algorithm){
+    return &(codecs[algorithm]);
+}
+
+//Parses a codec selection from the configuration file, as the name of a codec optionally followed by CODEC_LEVEL_SEPARATOR
+//and the compression level, like "zlib" or "lz:3". Returns false if there's no codec with that name or the level isn't valid
+//for it, otherwise stores the codec and the level, the default one of the codec if not specified
+bool parseCodec(const char* specification, CompressionAlgorithm* algorithm, int* level){
+    const char* separator = strchr(specification, CODEC_LEVEL_SEPARATOR);
+    size_t nameLength = separator == NULL ? strlen(specification) : (size_t)(separator - specification);
+    for(int i = 0; i < CompressionAlgorithmCount; i++){
+        const Codec* codec = &(codecs[i]);
+        if(strlen(codec->name) != nameLength || strncmp(codec->name, specification, nameLength) != 0){
+            continue;
+        }
+        int parsedLevel = codec->defaultLevel;
+        if(separator != NULL){
+            char* end = NULL;
+            long value = strtol(separator + 1, &end, 10);
+            if(end == separator + 1 || *end != '\0' || value < codec->minLevel || value > codec->maxLevel){
+                return false;
+            }
+            parsedLevel = (int)value;
+        }
+        *algorithm = i;
+        *level = parsedLevel;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,127 @@
+#include <malloc.h>
+#include <string.h>
+
+#include "../include/CompressionDictionary.h"
+
+
+
+//Returns the slot of the frequency table for the COMPRESSION_DICTIONARY_DMER_SIZE bytes starting at a position
+static uint32_t hashDmer(const char* dmer){
+    uint64_t sequence;
+    memcpy(&sequence, dmer, sizeof(uint64_t));
+    return (uint32_t)((sequence * 0x9E3779B97F4A7C15ull) >> (64 - COMPRESSION_DICTIONARY_HASH_BITS));
+}
+
+//Returns the score of the segment starting at a position, as the sum of the frequencies of the dmers in it
+static uint64_t scoreSegment(const char* segment, const uint32_t* frequencies){
+    uint64_t score = 0;
+    for(size_t i = 0; i + COMPRESSION_DICTIONARY_DMER_SIZE <= COMPRESSION_DICTIONARY_SEGMENT_SIZE; i++){
+        score += frequencies[hashDmer(segment + i)];
+    }
+    return score;
+}
+
+
+
+void acquireCompressionDictionary(CompressionDictionary* dictionary){
+    __atomic_add_fetch(&(dictionary->references), 1, __ATOMIC_RELAXED);
+}
+
+//Drops a reference to a dictionary, freeing it if it was the last one. Does nothing if the dictionary is NULL
+void releaseCompressionDictionary(CompressionDictionary* dictionary){
+    if(dictionary != NULL && __atomic_sub_fetch(&(dictionary->references), 1, __ATOMIC_ACQ_REL) == 0){
+        if(dictionary->prepared != NULL){
+            dictionary->freePrepared(dictionary->prepared);
+        }
+        free(dictionary);
+    }
+}
+
+//Builds a dictionary of up to capacity bytes out of the strings that recur in most samples, which are stored one after the
+//other in samples. Every sequence of COMPRESSION_DICTIONARY_DMER_SIZE bytes (dmer) is scored by the number of samples other
+//than the first one it appears in, since strings that only appear in one sample are left to the window of that sample.
+//Then, as in the FastCover algorithm, the samples are split in as many epochs as the segments of
+//COMPRESSION_DICTIONARY_SEGMENT_SIZE bytes that fit in the dictionary, and the segment with the highest score of each epoch
+//is added to it. The scores of the dmers of a segment added are cleared, so that the other segments don't repeat them.
+//The segments are placed from the end of the dictionary, closest to the data compressed with it, in the order they're chosen.
+//Returns the dictionary, referenced only by the caller, or NULL if there's no memory left or nothing recurs in the samples
+CompressionDictionary* trainCompressionDictionary(const char* samples, const size_t* sampleSizes, unsigned int sampleCount, size_t capacity, unsigned int id){
+    size_t totalSize = 0;
+    for(unsigned int i = 0; i < sampleCount; i++){
+        totalSize += sampleSizes[i];
+    }
+    if(totalSize < COMPRESSION_DICTIONARY_SEGMENT_SIZE || capacity < COMPRESSION_DICTIONARY_SEGMENT_SIZE){
+        return NULL;
+    }
+    uint32_t* frequencies = calloc((size_t)1 << COMPRESSION_DICTIONARY_HASH_BITS, sizeof(uint32_t));
+    //Last sample each dmer has been counted in, plus one, so that dmers repeated in a sample are counted once
+    uint32_t* lastSample = calloc((size_t)1 << COMPRESSION_DICTIONARY_HASH_BITS, sizeof(uint32_t));
+    CompressionDictionary* out = malloc(sizeof(CompressionDictionary) + capacity);
+    if(frequencies == NULL || lastSample == NULL || out == NULL){
+        free(frequencies);
+        free(lastSample);
+        free(out);
+        return NULL;
+    }
+    size_t offset = 0;
+    for(unsigned int i = 0; i < sampleCount; i++){
+        for(size_t j = 0; j + COMPRESSION_DICTIONARY_DMER_SIZE <= sampleSizes[i]; j++){
+            uint32_t slot = hashDmer(samples + offset + j);
+            if(lastSample[slot] != i + 1){
+                lastSample[slot] = i + 1;
+                frequencies[slot]++;
+            }
+        }
+        offset += sampleSizes[i];
+    }
+    free(lastSample);
+    for(size_t i = 0; i < (size_t)1 << COMPRESSION_DICTIONARY_HASH_BITS; i++){
+        if(frequencies[i] > 0){
+            frequencies[i]--;
+        }
+    }
+
+    size_t epochs = capacity / COMPRESSION_DICTIONARY_SEGMENT_SIZE;
+    size_t epochSize = totalSize / epochs;
+    if(epochSize < COMPRESSION_DICTIONARY_SEGMENT_SIZE){
+        epochSize = COMPRESSION_DICTIONARY_SEGMENT_SIZE;
+        epochs = totalSize / epochSize;
+    }
+    size_t room = capacity;
+    for(size_t epoch = 0; epoch < epochs && room >= COMPRESSION_DICTIONARY_SEGMENT_SIZE; epoch++){
+        //The score of each segment is computed from the one of the previous segment, as a sliding window
+        size_t begin = epoch * epochSize;
+        size_t end = begin + epochSize <= totalSize ? begin + epochSize : totalSize;
+        uint64_t score = scoreSegment(samples + begin, frequencies);
+        uint64_t bestScore = score;
+        size_t best = begin;
+        for(size_t position = begin + 1; position + COMPRESSION_DICTIONARY_SEGMENT_SIZE <= end; position++){
+            score -= frequencies[hashDmer(samples + position - 1)];
+            score += frequencies[hashDmer(samples + position + COMPRESSION_DICTIONARY_SEGMENT_SIZE - COMPRESSION_DICTIONARY_DMER_SIZE)];
+            if(score > bestScore){
+                bestScore = score;
+                best = position;
+            }
+        }
+        if(bestScore == 0){
+            continue;
+        }
+        room -= COMPRESSION_DICTIONARY_SEGMENT_SIZE;
+        memcpy(out->data + room, samples + best, COMPRESSION_DICTIONARY_SEGMENT_SIZE);
+        for(size_t i = 0; i + COMPRESSION_DICTIONARY_DMER_SIZE <= COMPRESSION_DICTIONARY_SEGMENT_SIZE; i++){
+            frequencies[hashDmer(samples + best + i)] = 0;
+        }
+    }
+    free(frequencies);
+    if(room == capacity){
+        free(out);
+        return NULL;
+    }
+    out->id = id;
+    out->references = 1;
+    out->prepared = NULL;
+    out->freePrepared = NULL;
+    out->size = capacity - room;
+    memmove(out->data, out->data + room, out->size);
+    return out;
+}
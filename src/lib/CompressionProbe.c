@@ -0,0 +1,83 @@
+#include <string.h>
+
+#include "../include/CompressionProbe.h"
+
+
+
+//Signature at the start of a file in a format that is compressed already
+typedef struct MagicNumber{
+    size_t offset;
+    size_t length;
+    const char* bytes;
+} MagicNumber;
+
+static const MagicNumber compressedFormats[] = {
+    {0, 3, "\xFF\xD8\xFF"}, //JPEG
+    {0, 8, "\x89PNG\r\n\x1A\n"}, //PNG
+    {0, 4, "GIF8"}, //GIF
+    {8, 4, "WEBP"}, //WebP, in a RIFF container
+    {4, 4, "ftyp"}, //MP4, MOV and HEIC
+    {0, 4, "OggS"}, //Ogg
+    {0, 4, "\x1A\x45\xDF\xA3"}, //Matroska and WebM
+    {0, 3, "ID3"}, //MP3
+    {0, 4, "PK\x03\x04"}, //ZIP, and the formats based on it like JAR, DOCX and ODT
+    {0, 2, "\x1F\x8B"}, //gzip
+    {0, 3, "BZh"}, //bzip2
+    {0, 6, "\xFD" "7zXZ\x00"}, //xz
+    {0, 4, "\x28\xB5\x2F\xFD"}, //Zstandard
+    {0, 6, "7z\xBC\xAF\x27\x1C"}, //7-Zip
+    {0, 4, "Rar!"} //RAR
+};
+
+
+
+//Returns whether a buffer starts with the signature of a format that is compressed already
+static bool isCompressedFormat(const char* data, size_t size){
+    for(size_t i = 0; i < sizeof(compressedFormats) / sizeof(MagicNumber); i++){
+        const MagicNumber* magic = &(compressedFormats[i]);
+        if(size >= magic->offset + magic->length && memcmp(data + magic->offset, magic->bytes, magic->length) == 0){
+            return true;
+        }
+    }
+    return false;
+}
+
+//Returns whether the bytes sampled from windows spread evenly over a buffer have an entropy too high for compression to pay off.
+//The collision entropy, -log2 of the sum of the squared frequencies of the byte values, is used instead of the Shannon one,
+//so that the threshold can be checked with integer operations only. It's never higher than the Shannon entropy,
+//so data that is close to random is still told apart from the data that compression shrinks
+static bool hasHighEntropy(const char* data, size_t size){
+    uint32_t histogram[256] = {0};
+    size_t stride = (size - COMPRESSION_PROBE_WINDOW_SIZE) / (COMPRESSION_PROBE_WINDOWS - 1);
+    for(size_t window = 0; window < COMPRESSION_PROBE_WINDOWS; window++){
+        const unsigned char* sample = (const unsigned char*)data + window * stride;
+        for(size_t i = 0; i < COMPRESSION_PROBE_WINDOW_SIZE; i++){
+            histogram[sample[i]]++;
+        }
+    }
+    uint64_t samples = COMPRESSION_PROBE_WINDOWS * COMPRESSION_PROBE_WINDOW_SIZE;
+    uint64_t collisions = 0;
+    for(int i = 0; i < 256; i++){
+        collisions += (uint64_t)histogram[i] * histogram[i];
+    }
+    //Entropy over log2(COMPRESSION_PROBE_ENTROPY_FACTOR) bits per byte
+    return collisions * COMPRESSION_PROBE_ENTROPY_FACTOR < samples * samples;
+}
+
+
+
+//Predicts whether compressing a buffer is worth it, by looking for the signatures of compressed formats and by sampling the
+//entropy of its bytes. Buffers smaller than COMPRESSION_PROBE_MIN_SIZE are always reported as compressible, since trying
+//to compress them is cheap and a sample of them wouldn't be significant
+CompressionProbeResult probeCompressibility(const char* data, size_t size){
+    if(size < COMPRESSION_PROBE_MIN_SIZE){
+        return ProbeCompressible;
+    }
+    if(isCompressedFormat(data, size)){
+        return ProbeKnownFormat;
+    }
+    if(hasHighEntropy(data, size)){
+        return ProbeHighEntropy;
+    }
+    return ProbeCompressible;
+}
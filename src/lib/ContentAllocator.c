@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../include/ContentAllocator.h"
+
+
+
+//Returns the size of the mapping of a large buffer, rounded up to whole pages
+static size_t getMappedSize(ContentAllocator* allocator, size_t size){
+    return (size + allocator->pageSize - 1) / allocator->pageSize * allocator->pageSize;
+}
+
+
+
+//Returns a buffer of at least size bytes, or NULL if there's no memory left
+char* contentAllocatorAllocate(ContentAllocator* allocator, size_t size){
+    if(size <= CONTENT_ALLOCATOR_LARGE_SIZE){
+        char* buffer = malloc(size > 0 ? size : 1);
+        if(buffer != NULL){
+            __atomic_add_fetch(&(allocator->heapBytes), size, __ATOMIC_RELAXED);
+        }
+        return buffer;
+    }
+    size_t mappedSize = getMappedSize(allocator, size);
+    char* buffer = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(buffer == MAP_FAILED){
+        return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    if(allocator->hugePages && mappedSize >= CONTENT_ALLOCATOR_HUGE_PAGE_SIZE){
+        //Only advice, the buffer is usable even if the kernel can't honor it
+        madvise(buffer, mappedSize, MADV_HUGEPAGE);
+    }
+#endif
+    __atomic_add_fetch(&(allocator->mappedBytes), mappedSize, __ATOMIC_RELAXED);
+    return buffer;
+}
+
+//Frees the allocator. The buffers still allocated have to be released before
+void contentAllocatorFree(ContentAllocator** allocator){
+    if(*allocator == NULL){
+        return;
+    }
+    free(*allocator);
+    *allocator = NULL;
+}
+
+ContentAllocator* contentAllocatorInit(bool hugePages){
+    ContentAllocator* out = malloc(sizeof(ContentAllocator));
+    if(out == NULL){
+        return NULL;
+    }
+    long pageSize = sysconf(_SC_PAGESIZE);
+    out->pageSize = pageSize > 0 ? pageSize : 4096;
+    out->hugePages = hugePages;
+    out->mappedBytes = 0;
+    out->heapBytes = 0;
+    return out;
+}
+
+//Gives back a buffer allocated with the same size
+void contentAllocatorRelease(ContentAllocator* allocator, char* buffer, size_t size){
+    if(buffer == NULL){
+        return;
+    }
+    if(size <= CONTENT_ALLOCATOR_LARGE_SIZE){
+        free(buffer);
+        __atomic_sub_fetch(&(allocator->heapBytes), size, __ATOMIC_RELAXED);
+        return;
+    }
+    size_t mappedSize = getMappedSize(allocator, size);
+    if(munmap(buffer, mappedSize)){
+        perror("Error while unmapping file contents");
+        return;
+    }
+    __atomic_sub_fetch(&(allocator->mappedBytes), mappedSize, __ATOMIC_RELAXED);
+}
+
+//Returns the memory taken by the allocator. Buffers allocated with malloc are counted for their size, without the overhead of malloc
+size_t contentAllocatorReservedBytes(ContentAllocator* allocator){
+    return __atomic_load_n(&(allocator->mappedBytes), __ATOMIC_RELAXED) + __atomic_load_n(&(allocator->heapBytes), __ATOMIC_RELAXED);
+}
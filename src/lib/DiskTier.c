@@ -0,0 +1,458 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../include/DiskTier.h"
+#include "../include/ion.h"
+
+
+
+//Header of a record in a segment, followed by the name of the file, not terminated, and then by its frames
+typedef struct DiskTierRecordHeader{
+    uint32_t filenameLength;
+    uint32_t frameCount;
+    uint64_t uncompressedSize;
+    uint64_t size; //Bytes of the frames, without their headers
+} DiskTierRecordHeader;
+
+//Destination of the frames of a file being written to a segment
+typedef struct DiskTierWriter{
+    int fd;
+    size_t bytesWritten;
+} DiskTierWriter;
+
+
+
+//Key function for the index of the records
+static const char* diskTierRecordKey(const void* record){
+    return ((const DiskTierRecord*)record)->filename;
+}
+
+//Writes the path of a segment in path, which has to be at least strlen(tier->directory) + 32 bytes long
+static void getSegmentPath(DiskTier* tier, unsigned int number, char* path, size_t size){
+    snprintf(path, size, "%s/segment-%u.log", tier->directory, number);
+}
+
+//Creates a new segment at the end of the log. Returns NULL if it can't be created
+static DiskTierSegment* openSegment(DiskTier* tier){
+    if(tier->segmentCount == tier->segmentCapacity){
+        unsigned int newCapacity = tier->segmentCapacity == 0 ? DISK_TIER_MIN_SEGMENTS * 2 : tier->segmentCapacity * 2;
+        DiskTierSegment** newSegments = realloc(tier->segments, newCapacity * sizeof(DiskTierSegment*));
+        if(newSegments == NULL){
+            perror("Error while creating disk tier segment");
+            return NULL;
+        }
+        tier->segments = newSegments;
+        tier->segmentCapacity = newCapacity;
+    }
+    DiskTierSegment* segment = malloc(sizeof(DiskTierSegment));
+    size_t pathLength = strlen(tier->directory) + 32;
+    char* path = malloc(pathLength);
+    if(segment == NULL || path == NULL){
+        perror("Error while creating disk tier segment");
+        free(segment);
+        free(path);
+        return NULL;
+    }
+    segment->number = tier->nextSegment++;
+    getSegmentPath(tier, segment->number, path, pathLength);
+    segment->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    free(path);
+    if(segment->fd == -1){
+        perror("Error while creating disk tier segment");
+        free(segment);
+        return NULL;
+    }
+    segment->size = 0;
+    segment->liveRecords = 0;
+    segment->records = NULL;
+    tier->segments[tier->segmentCount++] = segment;
+    return segment;
+}
+
+//Deletes the segment at position index of the log, together with its file. Its records have to have been freed already
+static void deleteSegment(DiskTier* tier, unsigned int index){
+    DiskTierSegment* segment = tier->segments[index];
+    size_t pathLength = strlen(tier->directory) + 32;
+    char* path = malloc(pathLength);
+    if(path != NULL){
+        getSegmentPath(tier, segment->number, path, pathLength);
+        unlink(path);
+        free(path);
+    }
+    close(segment->fd);
+    tier->size -= segment->size;
+    tier->segmentCount--;
+    memmove(tier->segments + index, tier->segments + index + 1, (tier->segmentCount - index) * sizeof(DiskTierSegment*));
+    tier->stats.segmentsReclaimed++;
+    free(segment);
+}
+
+//Removes a record from its segment, leaving its bytes dead. Deletes the segment if that was its last file, unless it's the one
+//being written
+static void unlinkRecord(DiskTier* tier, DiskTierRecord* record){
+    DiskTierSegment* segment = record->segment;
+    if(record->prev != NULL){
+        record->prev->next = record->next;
+    }else{
+        segment->records = record->next;
+    }
+    if(record->next != NULL){
+        record->next->prev = record->prev;
+    }
+    segment->liveRecords--;
+    if(segment->liveRecords == 0 && segment != tier->segments[tier->segmentCount - 1]){
+        for(unsigned int i = 0; i < tier->segmentCount; i++){
+            if(tier->segments[i] == segment){
+                deleteSegment(tier, i);
+                break;
+            }
+        }
+    }
+}
+
+//Removes a record from the index and from its segment, see unlinkRecord
+static void removeRecord(DiskTier* tier, DiskTierRecord* record){
+    hashIndexRemove(&(tier->index), record->filename);
+    unlinkRecord(tier, record);
+    free(record);
+}
+
+//Removes the record of a file being taken by diskTierTake from the index, and wakes up the requests waiting for it
+static void endRecordTake(DiskTier* tier, DiskTierRecord* record){
+    hashIndexRemove(&(tier->index), record->filename);
+    free(record);
+    pthread_cond_broadcast(&(tier->takeEnded));
+}
+
+//Returns the record of a file, or NULL if it isn't in the tier. If the file is being taken, waits until the take has ended,
+//since the file is then either in the cache or back in the tier. Has to be called with the lock of the tier held
+static DiskTierRecord* getSettledRecord(DiskTier* tier, const char* filename){
+    DiskTierRecord* record = hashIndexGet(&(tier->index), filename);
+    while(record != NULL && record->segment == NULL){
+        pthread_cond_wait(&(tier->takeEnded), &(tier->lock));
+        record = hashIndexGet(&(tier->index), filename);
+    }
+    return record;
+}
+
+//Deletes the oldest segment of the log, dropping the files still in it
+static void dropOldestSegment(DiskTier* tier){
+    DiskTierSegment* segment = tier->segments[0];
+    while(segment->records != NULL){
+        DiskTierRecord* record = segment->records;
+        segment->records = record->next;
+        hashIndexRemove(&(tier->index), record->filename);
+        free(record);
+        tier->stats.filesDropped++;
+    }
+    segment->liveRecords = 0;
+    deleteSegment(tier, 0);
+}
+
+//Appends a chunk of a record to the segment of a DiskTierWriter
+static bool writeRecordChunk(const char* chunk, size_t size, void* argument){
+    DiskTierWriter* writer = argument;
+    if(writen(writer->fd, (char*)chunk, size) < 0){
+        return false;
+    }
+    writer->bytesWritten += size;
+    return true;
+}
+
+//Appends the contents of a file to the log, then deletes the oldest segments while the log is larger than the capacity. The
+//file mustn't be in the tier already. Returns false if the file couldn't be written, or if it doesn't fit in the tier.
+//Has to be called with the lock of the tier held
+static bool appendRecord(DiskTier* tier, const char* filename, FileContents* contents){
+    size_t filenameLength = strlen(filename);
+    DiskTierRecord* record = malloc(sizeof(DiskTierRecord) + filenameLength + 1);
+    if(record == NULL){
+        perror("Error while writing file to disk tier");
+        return false;
+    }
+    memcpy(record->filename, filename, filenameLength + 1);
+    //Summed from the segments, since the contents of a file that couldn't be restored haven't been sealed
+    record->uncompressedSize = 0;
+    record->frameCount = 0;
+    for(unsigned int i = 0; contents != NULL && i < contents->segmentCount; i++){
+        record->uncompressedSize += contents->segments[i]->uncompressedSize;
+        //Empty segments have no frame, see streamFileFrames
+        if(contents->segments[i]->uncompressedSize > 0){
+            record->frameCount++;
+        }
+    }
+
+    DiskTierSegment* segment = tier->segmentCount == 0 ? NULL : tier->segments[tier->segmentCount - 1];
+    if(segment == NULL || segment->size >= tier->segmentSize){
+        segment = openSegment(tier);
+    }
+    bool written = segment != NULL;
+    if(written){
+        //The size of the frames is only known once they're written, the header is written again then
+        DiskTierRecordHeader header = {filenameLength, record->frameCount, record->uncompressedSize, 0};
+        DiskTierWriter writer = {segment->fd, 0};
+        off_t start = segment->size;
+        written = writeRecordChunk((const char*)&header, sizeof(DiskTierRecordHeader), &writer)
+                && writeRecordChunk(filename, filenameLength, &writer)
+                && streamFileFrames(contents, FCP_CODEC_BIT(CompressionAlgorithmCount) - 1, writeRecordChunk, &writer);
+        if(written){
+            header.size = writer.bytesWritten - sizeof(DiskTierRecordHeader) - filenameLength - record->frameCount * sizeof(FCPFrameHeader);
+            written = pwrite(segment->fd, &header, sizeof(DiskTierRecordHeader), start) == sizeof(DiskTierRecordHeader);
+        }
+        if(written){
+            record->segment = segment;
+            record->offset = start + sizeof(DiskTierRecordHeader) + filenameLength;
+            record->length = writer.bytesWritten;
+            record->size = header.size;
+            //The record takes the bytes it has been written in even if it can't be indexed, they'll be dead
+            segment->size += writer.bytesWritten;
+            tier->size += writer.bytesWritten;
+            written = hashIndexInsert(&(tier->index), record);
+        }else{
+            //The segment is cut back to the end of the previous record
+            perror("Error while writing file to disk tier");
+            if(ftruncate(segment->fd, start) == -1 || lseek(segment->fd, start, SEEK_SET) == -1){
+                perror("Error while rolling back disk tier segment");
+            }
+        }
+    }
+    if(written){
+        record->prev = NULL;
+        record->next = segment->records;
+        if(segment->records != NULL){
+            segment->records->prev = record;
+        }
+        segment->records = record;
+        segment->liveRecords++;
+        tier->stats.filesWritten++;
+        tier->stats.bytesWritten += record->length;
+    }else{
+        free(record);
+    }
+    while(tier->size > tier->capacity && tier->segmentCount > 0){
+        if(written && tier->segments[0] == record->segment){
+            //The file is larger than what's left of the tier, so it goes along with everything else
+            written = false;
+        }
+        dropOldestSegment(tier);
+    }
+    return written;
+}
+
+//Reads size bytes of a segment starting at offset. Returns false if there's an error or the segment ends before
+static bool readSegment(int fd, char* buffer, size_t size, off_t offset){
+    while(size > 0){
+        ssize_t bytesRead = pread(fd, buffer, size, offset);
+        if(bytesRead < 0 && errno == EINTR){
+            continue;
+        }
+        if(bytesRead <= 0){
+            return false;
+        }
+        buffer += bytesRead;
+        size -= bytesRead;
+        offset += bytesRead;
+    }
+    return true;
+}
+
+
+
+//Returns whether a file is in the tier, setting size to the bytes it would take in the cache if it is. A file being taken by
+//diskTierTake is still in the tier until the take has ended
+bool diskTierContains(DiskTier* tier, const char* filename, size_t* size){
+    pthread_mutex_lock(&(tier->lock));
+    DiskTierRecord* record = hashIndexGet(&(tier->index), filename);
+    if(record != NULL){
+        *size = record->size;
+    }
+    pthread_mutex_unlock(&(tier->lock));
+    return record != NULL;
+}
+
+//Ends the take of a file started by diskTierTake, once the caller has tried to restore it in the cache. If the file couldn't
+//be restored, its contents are passed back and written to the tier again, as by diskTierPut; they're still pinned by the
+//caller afterwards. Otherwise contents is NULL, and the file leaves the tier. Returns false if contents couldn't be written back
+bool diskTierEndTake(DiskTier* tier, const char* filename, FileContents* contents){
+    pthread_mutex_lock(&(tier->lock));
+    DiskTierRecord* record = hashIndexGet(&(tier->index), filename);
+    bool written = true;
+    if(record != NULL){
+        if(contents == NULL){
+            tier->stats.filesPromoted++;
+            tier->stats.bytesRead += record->length;
+        }
+        endRecordTake(tier, record);
+        if(contents != NULL){
+            written = appendRecord(tier, filename, contents);
+        }
+    }
+    pthread_mutex_unlock(&(tier->lock));
+    return written;
+}
+
+//Appends the contents of a file evicted from the cache to the log, replacing the copy already in the tier if there's one,
+//then deletes the oldest segments while the log is larger than the capacity. The contents have to be pinned by the caller.
+//Returns false if the file couldn't be written, or if it doesn't fit in the tier
+bool diskTierPut(DiskTier* tier, const char* filename, FileContents* contents){
+    pthread_mutex_lock(&(tier->lock));
+    DiskTierRecord* oldRecord = getSettledRecord(tier, filename);
+    if(oldRecord != NULL){
+        removeRecord(tier, oldRecord);
+    }
+    bool written = appendRecord(tier, filename, contents);
+    pthread_mutex_unlock(&(tier->lock));
+    return written;
+}
+
+//Removes a file from the tier, so that it isn't restored after the file is removed from the cache. Returns whether it was there
+bool diskTierRemove(DiskTier* tier, const char* filename){
+    pthread_mutex_lock(&(tier->lock));
+    DiskTierRecord* record = getSettledRecord(tier, filename);
+    if(record != NULL){
+        removeRecord(tier, record);
+    }
+    pthread_mutex_unlock(&(tier->lock));
+    return record != NULL;
+}
+
+//Takes a file out of the tier to restore it in the cache, reading it back from the log. Only the lookup of its record is done
+//with the lock of the tier held, the file is read through a duplicate of the descriptor of its segment, so that the segment
+//can be deleted in the meantime. Until diskTierEndTake is called, the file is still reported by diskTierContains, and the
+//other requests for it wait for the take to end. The frames are stored by uploadFileFrame, which checks that the compressed
+//ones decompress correctly, so a corrupt segment doesn't end up in the cache. Returns the contents, to be passed to restoreFile,
+//setting size to the bytes they take in the cache, or NULL if the file isn't in the tier or if it can't be read, in which case
+//it's lost and the take has already ended
+FileContents* diskTierTake(DiskTier* tier, FileCache* fileCache, const char* filename, size_t* size){
+    pthread_mutex_lock(&(tier->lock));
+    DiskTierRecord* record = getSettledRecord(tier, filename);
+    if(record == NULL){
+        pthread_mutex_unlock(&(tier->lock));
+        return NULL;
+    }
+    int fd = dup(record->segment->fd);
+    off_t offset = record->offset;
+    size_t sizeLeft = record->size;
+    unsigned int frameCount = record->frameCount;
+    *size = record->size;
+    unlinkRecord(tier, record);
+    record->segment = NULL;
+    pthread_mutex_unlock(&(tier->lock));
+
+    FileContents* contents = fd == -1 ? NULL : beginFileRestore(frameCount);
+    bool restored = contents != NULL;
+    for(unsigned int i = 0; restored && i < frameCount; i++){
+        FCPFrameHeader header;
+        restored = readSegment(fd, (char*)&header, sizeof(FCPFrameHeader), offset);
+        offset += sizeof(FCPFrameHeader);
+        restored = restored && (unsigned char)header.compression < CompressionAlgorithmCount && header.size > 0 && header.size <= sizeLeft;
+        restored = restored && (header.compression != Uncompressed || header.size == header.uncompressedSize);
+        char* data = restored ? allocateFileData(fileCache, header.size) : NULL;
+        if(data == NULL){
+            restored = false;
+            break;
+        }
+        if(!readSegment(fd, data, header.size, offset)){
+            releaseFileData(fileCache, data, header.size);
+            restored = false;
+            break;
+        }
+        offset += header.size;
+        sizeLeft -= header.size;
+        restored = uploadFileFrame(fileCache, contents, i, data, header.size, header.uncompressedSize, header.compression);
+    }
+    if(fd != -1){
+        close(fd);
+    }
+    if(!restored){
+        fprintf(stderr, "Error while reading file \"%s\" from disk tier, file dropped\n", filename);
+        unpinFileContents(contents);
+        pthread_mutex_lock(&(tier->lock));
+        endRecordTake(tier, hashIndexGet(&(tier->index), filename));
+        pthread_mutex_unlock(&(tier->lock));
+        return NULL;
+    }
+    return contents;
+}
+
+//Deletes all the segments of the log, and frees the tier
+void freeDiskTier(DiskTier** tier){
+    if(tier == NULL || *tier == NULL){
+        return;
+    }
+    while((*tier)->segmentCount > 0){
+        dropOldestSegment(*tier);
+    }
+    hashIndexFree(&((*tier)->index));
+    pthread_mutex_destroy(&((*tier)->lock));
+    pthread_cond_destroy(&((*tier)->takeEnded));
+    free((*tier)->segments);
+    free((*tier)->directory);
+    free(*tier);
+    *tier = NULL;
+}
+
+//Initializes an empty tier of capacity bytes in a directory, creating it if it doesn't exist. The segments left in it by a
+//previous run are deleted, since the index they'd need isn't kept across runs. Returns NULL if there's an error
+DiskTier* initDiskTier(const char* directory, size_t capacity){
+    if(mkdir(directory, 0755) == -1 && errno != EEXIST){
+        perror("Error while creating disk tier directory");
+        return NULL;
+    }
+    DIR* dir = opendir(directory);
+    if(dir == NULL){
+        perror("Error while opening disk tier directory");
+        return NULL;
+    }
+    DiskTier* out = malloc(sizeof(DiskTier));
+    if(out == NULL){
+        closedir(dir);
+        return NULL;
+    }
+    out->directory = strdup(directory);
+    if(out->directory == NULL || !hashIndexInit(&(out->index), DISK_TIER_INDEX_CAPACITY, diskTierRecordKey, NULL)){
+        closedir(dir);
+        free(out->directory);
+        free(out);
+        return NULL;
+    }
+    struct dirent* entry;
+    while((entry = readdir(dir)) != NULL){
+        unsigned int number;
+        char suffix[8];
+        if(sscanf(entry->d_name, "segment-%u%7s", &number, suffix) == 2 && strcmp(suffix, ".log") == 0){
+            unlinkat(dirfd(dir), entry->d_name, 0);
+        }
+    }
+    closedir(dir);
+    if(pthread_mutex_init(&(out->lock), NULL)){
+        perror("Error while initializing disk tier lock");
+        hashIndexFree(&(out->index));
+        free(out->directory);
+        free(out);
+        return NULL;
+    }
+    if(pthread_cond_init(&(out->takeEnded), NULL)){
+        perror("Error while initializing disk tier condition variable");
+        pthread_mutex_destroy(&(out->lock));
+        hashIndexFree(&(out->index));
+        free(out->directory);
+        free(out);
+        return NULL;
+    }
+    out->capacity = capacity;
+    out->segmentSize = capacity / DISK_TIER_MIN_SEGMENTS < DISK_TIER_SEGMENT_SIZE ? capacity / DISK_TIER_MIN_SEGMENTS : DISK_TIER_SEGMENT_SIZE;
+    out->size = 0;
+    out->segments = NULL;
+    out->segmentCount = 0;
+    out->segmentCapacity = 0;
+    out->nextSegment = 0;
+    memset(&(out->stats), 0, sizeof(DiskTierStatistics));
+    return out;
+}
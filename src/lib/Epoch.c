@@ -0,0 +1,134 @@
+#include <limits.h>
+#include <malloc.h>
+#include <stdio.h>
+
+#include "../include/Epoch.h"
+
+
+
+//Frees the retired pointers that no participant can still reference. Has to be called with the retired lock held
+static void freeUnreachable(EpochDomain* domain){
+    //A participant that entered in an epoch later than the one a pointer was retired in found it already unlinked
+    unsigned long oldestActive = ULONG_MAX;
+    for(unsigned int i = 0; i < domain->participantCount; i++){
+        unsigned long epoch = __atomic_load_n(&(domain->participants[i].epoch), __ATOMIC_SEQ_CST);
+        if(epoch != 0 && epoch < oldestActive){
+            oldestActive = epoch;
+        }
+    }
+    while(domain->oldestRetired != NULL && domain->oldestRetired->epoch < oldestActive){
+        RetiredPointer* retired = domain->oldestRetired;
+        domain->oldestRetired = retired->next;
+        retired->destructor(retired->pointer);
+        free(retired);
+        __atomic_sub_fetch(&(domain->retiredCount), 1, __ATOMIC_RELAXED);
+    }
+    if(domain->oldestRetired == NULL){
+        domain->newestRetired = NULL;
+    }
+}
+
+
+
+//Frees the retired pointers that can be freed, waiting for the retired lock if another thread is holding it
+void epochCollect(EpochDomain* domain){
+    if(domain == NULL){
+        return;
+    }
+    pthread_mutex_lock(&(domain->retiredLock));
+    freeUnreachable(domain);
+    pthread_mutex_unlock(&(domain->retiredLock));
+}
+
+//Starts a critical section, during which the objects found in the structures protected by the domain stay valid
+void epochEnter(EpochDomain* domain, unsigned int participant){
+    if(domain == NULL){
+        return;
+    }
+    unsigned long epoch = __atomic_load_n(&(domain->epoch), __ATOMIC_SEQ_CST);
+    __atomic_store_n(&(domain->participants[participant].epoch), epoch, __ATOMIC_SEQ_CST);
+    //The announcement has to be visible before any shared structure is read
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+//Ends a critical section. If there are retired pointers waiting and no other thread is freeing them, tries to free them
+void epochExit(EpochDomain* domain, unsigned int participant){
+    if(domain == NULL){
+        return;
+    }
+    __atomic_store_n(&(domain->participants[participant].epoch), 0, __ATOMIC_RELEASE);
+    if(__atomic_load_n(&(domain->retiredCount), __ATOMIC_RELAXED) > 0 && pthread_mutex_trylock(&(domain->retiredLock)) == 0){
+        freeUnreachable(domain);
+        pthread_mutex_unlock(&(domain->retiredLock));
+    }
+}
+
+//Frees the domain together with all the pointers still retired. No participant can be inside a critical section
+void epochFree(EpochDomain** domain){
+    if(*domain == NULL){
+        return;
+    }
+    while((*domain)->oldestRetired != NULL){
+        RetiredPointer* retired = (*domain)->oldestRetired;
+        (*domain)->oldestRetired = retired->next;
+        retired->destructor(retired->pointer);
+        free(retired);
+    }
+    pthread_mutex_destroy(&((*domain)->retiredLock));
+    free((*domain)->participants);
+    free(*domain);
+    *domain = NULL;
+}
+
+EpochDomain* epochInit(unsigned int participantCount){
+    EpochDomain* out = malloc(sizeof(EpochDomain));
+    if(out == NULL){
+        return NULL;
+    }
+    out->participants = calloc(participantCount, sizeof(EpochParticipant));
+    if(out->participants == NULL){
+        free(out);
+        return NULL;
+    }
+    if(pthread_mutex_init(&(out->retiredLock), NULL)){
+        perror("Error while initializing retired pointers lock");
+        free(out->participants);
+        free(out);
+        return NULL;
+    }
+    out->epoch = 1;
+    out->participantCount = participantCount;
+    out->oldestRetired = NULL;
+    out->newestRetired = NULL;
+    out->retiredCount = 0;
+    return out;
+}
+
+//Hands a pointer that has been unlinked from the shared structures to the domain, which frees it with the destructor once
+//no participant can still reference it. Without a domain, the pointer is freed immediately
+void epochRetire(EpochDomain* domain, void* pointer, EpochDestructor destructor){
+    if(domain == NULL){
+        destructor(pointer);
+        return;
+    }
+    RetiredPointer* retired = malloc(sizeof(RetiredPointer));
+    if(retired == NULL){
+        //Leaking the pointer is better than freeing it while it might still be in use
+        perror("Error while retiring pointer");
+        return;
+    }
+    retired->pointer = pointer;
+    retired->destructor = destructor;
+    retired->next = NULL;
+    pthread_mutex_lock(&(domain->retiredLock));
+    retired->epoch = __atomic_fetch_add(&(domain->epoch), 1, __ATOMIC_SEQ_CST);
+    if(domain->newestRetired == NULL){
+        domain->oldestRetired = retired;
+    }else{
+        domain->newestRetired->next = retired;
+    }
+    domain->newestRetired = retired;
+    __atomic_add_fetch(&(domain->retiredCount), 1, __ATOMIC_RELAXED);
+    freeUnreachable(domain);
+    pthread_mutex_unlock(&(domain->retiredLock));
+}
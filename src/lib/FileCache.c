@@ -1,328 +1,1989 @@
-#include <sys/time.h>
 #include "../include/FileCache.h"
-#include "../include/miniz.h"
-#include "../include/TimespecUtils.h"
 
+#define CLOCK_RING_INITIAL_CAPACITY 64
+#define GDSF_COMPRESSION_COST_FACTOR 1.5
+#define GDSF_HEAP_INITIAL_CAPACITY 64
+#define GDSF_NOT_IN_HEAP ((size_t)-1)
+#define GDSF_TRANSFER_UNIT 65536.0
+#define BLOB_HASH_LANES 4
+#define BLOB_HASH_MULTIPLIER 0xFF51AFD7ED558CCDull
+#define BLOB_HASH_SEED 0x9E3779B97F4A7C15ull
 
-//Adds a file to the head of a list of files
-static void addFile(FileList** list, CachedFile* file){
-    FileList* newNode = malloc(sizeof(FileList));
-    newNode->file = file;
+
+//A file, its node in the file list of its shard and its name, allocated together from one of the slabs of the shard,
+//so that creating a file takes a single allocation and the fields used together share cache lines
+typedef struct FileRecord{
+    Slab* slab; //Slab the record has to be released to
+    FileList node;
+    CachedFile file;
+    char filename[];
+} FileRecord;
+
+//Range of the uncompressed contents of a file being passed to an output by streamFileRange
+typedef struct FileRange{
+    size_t skip; //Bytes of the current segment before the range
+    size_t size; //Bytes of the range not yet passed to output
+    bool failed; //Set if output returned false
+    CodecOutput output;
+    void* argument;
+} FileRange;
+
+//Length of the longest filename, terminator included, that the records of each size class can hold
+static const size_t fileRecordNameCapacities[FILE_RECORD_SIZE_CLASSES] = {32, 64, 128, MAX_FILENAME_SIZE + 1};
+
+
+
+//Adds the node of a file to the head of a list of files
+static void addFile(FileList** list, FileList* newNode){
     newNode->next = *list;
+    newNode->prev = NULL;
+    if(*list != NULL){
+        (*list)->prev = newNode;
+    }
     *list = newNode;
 }
 
-//Recursively frees all the nodes from a file list
-static void freeFileList(FileList** fileList){
-    if(*fileList != NULL){
-        freeFileList(&((*fileList)->next));
-        freeCachedFile((*fileList)->file);
-        free(*fileList);
-        *fileList = NULL;
+//Key function for the file index, the nodes of the file list are indexed by filename
+static const char* fileListNodeKey(const void* node){
+    return ((const FileList*)node)->file->filename;
+}
+
+//Returns the shard a file belongs to. The high bits of the hash are used, since the low ones select the slot in the index
+//of the shard and would otherwise be the same for all of its files
+static FileCacheShard* getShard(FileCache* fileCache, const char* filename){
+    return &(fileCache->shards[((unsigned long long)hashString(filename) * fileCache->shardCount) >> 32]);
+}
+
+//Stores a buffer allocated from the content allocator in a new segment, referenced only by the caller. Uncompressed data is
+//left to be compressed in background if the FileCache has been configured to compress the files. The buffer is owned by the
+//segment, or released if there's an error
+static FileSegment* newFileSegment(FileCache* fileCache, char* data, size_t size, size_t uncompressedSize, CompressionAlgorithm compression){
+    FileSegment* out = malloc(sizeof(FileSegment));
+    if(out == NULL){
+        contentAllocatorRelease(fileCache->contentAllocator, data, size);
+        return NULL;
+    }
+    out->data = data;
+    out->size = size;
+    out->uncompressedSize = uncompressedSize;
+    out->compression = compression;
+    out->dictionary = NULL;
+    out->compressionPending = compression == Uncompressed && fileCache->compressionAlgorithm != Uncompressed && size > 0;
+    out->references = 1;
+    out->owners = 0;
+    out->allocator = fileCache->contentAllocator;
+    out->blobs = NULL;
+    out->blobKey[0] = '\0';
+    return out;
+}
+
+//Trains a dictionary on the samples collected, and makes it the one the next small segments are compressed with. Has to be
+//called without holding the lock of the trainer, by the thread that set training
+static void trainDictionary(FileCache* fileCache){
+    DictionaryTrainer* trainer = fileCache->dictionaries;
+    //The samples can be read without the lock, since they're not collected while training
+    CompressionDictionary* dictionary = trainCompressionDictionary(trainer->samples, trainer->sampleSizes, trainer->sampleCount, FILE_DICTIONARY_SIZE, trainer->trained + 1);
+    const Codec* codec = getCodec(fileCache->compressionAlgorithm);
+    if(dictionary != NULL && codec->prepareDictionary != NULL){
+        dictionary->prepared = codec->prepareDictionary(dictionary->data, dictionary->size, fileCache->compressionLevel);
+        dictionary->freePrepared = codec->freePreparedDictionary;
+        if(dictionary->prepared == NULL){
+            releaseCompressionDictionary(dictionary);
+            dictionary = NULL;
+        }
+    }
+    pthread_mutex_lock(&(trainer->lock));
+    if(dictionary != NULL){
+        //The segments compressed with the previous dictionary keep it alive
+        releaseCompressionDictionary(trainer->current);
+        trainer->current = dictionary;
+        trainer->trained++;
+        trainer->segmentsSinceTraining = 0;
+    }
+    trainer->samplesSize = 0;
+    trainer->sampleCount = 0;
+    trainer->training = false;
+    pthread_mutex_unlock(&(trainer->lock));
+}
+
+//Returns the dictionary a small segment has to be compressed with, referenced for the caller, or NULL if none has been trained
+//yet. Until the first dictionary is trained, and every FILE_DICTIONARY_RETRAINING_SEGMENTS segments after, the segments are
+//collected as samples. The thread that fills the samples trains the next dictionary
+static CompressionDictionary* getCompressionDictionary(FileCache* fileCache, const char* data, size_t size){
+    DictionaryTrainer* trainer = fileCache->dictionaries;
+    pthread_mutex_lock(&(trainer->lock));
+    bool collecting = !trainer->training && (trainer->current == NULL || trainer->segmentsSinceTraining >= FILE_DICTIONARY_RETRAINING_SEGMENTS);
+    if(collecting && trainer->samplesSize + size <= FILE_DICTIONARY_SAMPLES_SIZE && trainer->sampleCount < FILE_DICTIONARY_MAX_SAMPLES){
+        memcpy(trainer->samples + trainer->samplesSize, data, size);
+        trainer->samplesSize += size;
+        trainer->sampleSizes[trainer->sampleCount++] = size;
     }
+    bool train = collecting && (trainer->samplesSize + FILE_DICTIONARY_MAX_SEGMENT_SIZE > FILE_DICTIONARY_SAMPLES_SIZE || trainer->sampleCount == FILE_DICTIONARY_MAX_SAMPLES);
+    if(train){
+        trainer->training = true;
+    }
+    pthread_mutex_unlock(&(trainer->lock));
+    if(train){
+        trainDictionary(fileCache);
+    }
+
+    pthread_mutex_lock(&(trainer->lock));
+    CompressionDictionary* out = trainer->current;
+    if(out != NULL){
+        acquireCompressionDictionary(out);
+        trainer->segmentsSinceTraining++;
+    }
+    pthread_mutex_unlock(&(trainer->lock));
+    return out;
 }
 
-static CachedFile* initCachedFile(const char* filename){
-    CachedFile* out = malloc(sizeof(CachedFile));
+//Attempts to compress data with the codec the FileCache has been configured with, returning a new segment holding the
+//compressed data, referenced only by the caller. The data passed is left untouched. Returns NULL if the compression is disabled
+//or fails, or if the size of the compressed buffer is equal or higher than that of the original one, in which case the data
+//should be stored non-compressed, for space and performance reasons
+static FileSegment* compressFileSegment(FileCache* fileCache, const char* data, size_t size){
+    if(fileCache->compressionAlgorithm == Uncompressed){
+        return NULL;
+    }
+    //Data that wouldn't shrink is recognized from its format or from a sample of it, without compressing all of it
+    CompressionProbeResult probe = probeCompressibility(data, size);
+    if(probe != ProbeCompressible){
+        __atomic_add_fetch(probe == ProbeKnownFormat ? &(fileCache->compressionStats.skippedByFormat) : &(fileCache->compressionStats.skippedByEntropy), 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    //Small segments are compressed with the preset dictionary, since they have too little data to find repetitions in it
+    CompressionDictionary* dictionary = fileCache->dictionaries != NULL && size <= FILE_DICTIONARY_MAX_SEGMENT_SIZE ? getCompressionDictionary(fileCache, data, size) : NULL;
+    //Compression in a scratch buffer, since the compressed size is only known afterwards
+    const Codec* codec = getCodec(fileCache->compressionAlgorithm);
+    size_t capacity = codec->bound(size);
+    char* compressedBuffer = malloc(capacity);
+    size_t compressedSize = 0;
+    if(compressedBuffer != NULL){
+        compressedSize = dictionary == NULL ? codec->compress(data, size, compressedBuffer, capacity, fileCache->compressionLevel) : codec->compressWithDictionary(dictionary->data, dictionary->size, dictionary->prepared, data, size, compressedBuffer, capacity, fileCache->compressionLevel);
+    }
+    char* fittedBuffer = compressedSize > 0 && compressedSize < size ? contentAllocatorAllocate(fileCache->contentAllocator, compressedSize) : NULL;
+    if(fittedBuffer != NULL){
+        memcpy(fittedBuffer, compressedBuffer, compressedSize);
+    }
+    free(compressedBuffer);
+    __atomic_add_fetch(fittedBuffer == NULL ? &(fileCache->compressionStats.notShrunk) : &(fileCache->compressionStats.compressed), 1, __ATOMIC_RELAXED);
+    FileSegment* out = fittedBuffer == NULL ? NULL : newFileSegment(fileCache, fittedBuffer, compressedSize, size, fileCache->compressionAlgorithm);
+    if(out != NULL && dictionary != NULL){
+        //The segment takes over the reference to the dictionary
+        out->dictionary = dictionary;
+        dictionary = NULL;
+        __atomic_add_fetch(&(fileCache->compressionStats.compressedWithDictionary), 1, __ATOMIC_RELAXED);
+    }
+    releaseCompressionDictionary(dictionary);
+    return out;
+}
+
+//Drops a reference to a segment, freeing it if it was the last one
+static void releaseFileSegment(FileSegment* segment){
+    if(segment != NULL && __atomic_sub_fetch(&(segment->references), 1, __ATOMIC_ACQ_REL) == 0){
+        if(segment->blobs != NULL){
+            //The key might have been taken over by a compressed copy of the segment
+            pthread_mutex_lock(&(segment->blobs->lock));
+            if(hashIndexGet(&(segment->blobs->index), segment->blobKey) == segment){
+                hashIndexRemove(&(segment->blobs->index), segment->blobKey);
+            }
+            pthread_mutex_unlock(&(segment->blobs->lock));
+        }
+        contentAllocatorRelease(segment->allocator, segment->data, segment->size);
+        releaseCompressionDictionary(segment->dictionary);
+        free(segment);
+    }
+}
+
+//Key function for the blob table
+static const char* fileSegmentKey(const void* segment){
+    return ((const FileSegment*)segment)->blobKey;
+}
+
+//Writes in key the hash of data, in hexadecimal. The data is read 8 bytes at a time, in BLOB_HASH_LANES independent lanes
+//that the processor can mix in parallel, so that hashing costs little compared to storing the data
+static void hashFileData(const char* data, size_t size, char key[FILE_BLOB_KEY_SIZE]){
+    uint64_t lanes[BLOB_HASH_LANES];
+    for(int i = 0; i < BLOB_HASH_LANES; i++){
+        lanes[i] = BLOB_HASH_SEED * (i + 1) ^ size;
+    }
+    size_t offset = 0;
+    for(; offset + BLOB_HASH_LANES * sizeof(uint64_t) <= size; offset += BLOB_HASH_LANES * sizeof(uint64_t)){
+        for(int i = 0; i < BLOB_HASH_LANES; i++){
+            uint64_t word;
+            memcpy(&word, data + offset + i * sizeof(uint64_t), sizeof(uint64_t));
+            lanes[i] = (lanes[i] ^ word) * BLOB_HASH_MULTIPLIER;
+            lanes[i] ^= lanes[i] >> 32;
+        }
+    }
+    uint64_t hash = 0;
+    for(int i = 0; i < BLOB_HASH_LANES; i++){
+        hash = (hash ^ lanes[i]) * BLOB_HASH_MULTIPLIER;
+    }
+    for(; offset < size; offset += sizeof(uint64_t)){
+        uint64_t word = 0;
+        memcpy(&word, data + offset, size - offset < sizeof(uint64_t) ? size - offset : sizeof(uint64_t));
+        hash = (hash ^ word) * BLOB_HASH_MULTIPLIER;
+        hash ^= hash >> 29;
+    }
+    hash = (hash ^ (hash >> 32)) * BLOB_HASH_MULTIPLIER;
+    snprintf(key, FILE_BLOB_KEY_SIZE, "%016llx", (unsigned long long)(hash ^ (hash >> 29)));
+}
+
+//Compares a chunk of a segment being streamed by fileSegmentEquals with the same bytes of the data it's compared to,
+//stopping the stream at the first difference
+static bool compareSegmentChunk(const char* chunk, size_t size, void* argument){
+    const char** data = argument;
+    bool equal = memcmp(chunk, *data, size) == 0;
+    *data += size;
+    return equal;
+}
+
+//Returns whether a compressed segment received from a client decompresses to exactly its uncompressed size. The segment is
+//decompressed whole in a scratch buffer, by the same function that compressFile's output is read back with
+static bool isValidFrame(FileSegment* segment){
+    char* scratch = malloc(segment->uncompressedSize > 0 ? segment->uncompressedSize : 1);
+    if(scratch == NULL){
+        return false;
+    }
+    bool valid = getCodec(segment->compression)->decompress(segment->data, segment->size, scratch, segment->uncompressedSize);
+    free(scratch);
+    return valid;
+}
+
+//Returns whether a segment holds the data passed, decompressing it a window at a time if needed
+static bool fileSegmentEquals(FileSegment* segment, const char* data, size_t size){
+    return segment->uncompressedSize == size && streamFileSegment(segment, compareSegmentChunk, &data);
+}
+
+//Returns the segment indexed in the blob table by key, with a reference taken for the caller, if it holds the data passed,
+//otherwise NULL. If the segment is looked up to replace another one, the one replaced is never returned, and neither are
+//segments that haven't been compressed yet. The segment is only referenced if it isn't being freed, and is compared with
+//the data after releasing the lock of the table, since the key is only a hash
+static FileSegment* findBlob(BlobTable* blobs, const char* key, const char* data, size_t size, FileSegment* replaced){
+    pthread_mutex_lock(&(blobs->lock));
+    FileSegment* out = hashIndexGet(&(blobs->index), key);
+    if(out != NULL && replaced != NULL && (out == replaced || __atomic_load_n(&(out->compressionPending), __ATOMIC_RELAXED))){
+        out = NULL;
+    }
+    if(out != NULL){
+        unsigned int references = __atomic_load_n(&(out->references), __ATOMIC_RELAXED);
+        while(references > 0 && !__atomic_compare_exchange_n(&(out->references), &references, references + 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+        if(references == 0){
+            out = NULL;
+        }
+    }
+    pthread_mutex_unlock(&(blobs->lock));
+    if(out != NULL && !fileSegmentEquals(out, data, size)){
+        releaseFileSegment(out);
+        out = NULL;
+    }
+    if(out != NULL){
+        __atomic_add_fetch(&(blobs->hits), 1, __ATOMIC_RELAXED);
+    }
+    return out;
+}
+
+//Indexes a segment in the blob table by key, unless another segment already is
+static void addBlob(BlobTable* blobs, FileSegment* segment, const char* key){
+    memcpy(segment->blobKey, key, FILE_BLOB_KEY_SIZE);
+    pthread_mutex_lock(&(blobs->lock));
+    if(hashIndexInsert(&(blobs->index), segment)){
+        segment->blobs = blobs;
+    }
+    pthread_mutex_unlock(&(blobs->lock));
+}
+
+//Has a compressed copy of a segment take its place in the blob table, if the segment is still indexed there
+static void replaceBlob(FileSegment* segment, FileSegment* compressed){
+    BlobTable* blobs = segment->blobs;
+    if(blobs == NULL){
+        return;
+    }
+    memcpy(compressed->blobKey, segment->blobKey, FILE_BLOB_KEY_SIZE);
+    pthread_mutex_lock(&(blobs->lock));
+    if(hashIndexGet(&(blobs->index), segment->blobKey) == segment){
+        hashIndexRemove(&(blobs->index), segment->blobKey);
+        if(hashIndexInsert(&(blobs->index), compressed)){
+            compressed->blobs = blobs;
+        }
+    }
+    pthread_mutex_unlock(&(blobs->lock));
+}
+
+//Allocates empty contents with room for segmentCount segments, referenced only by the caller. The offsets of the segments are
+//allocated together with them, after the array of the segments
+static FileContents* newFileContents(unsigned int segmentCount){
+    FileContents* out = malloc(sizeof(FileContents) + segmentCount * (sizeof(FileSegment*) + sizeof(size_t)));
     if(out == NULL){
         return NULL;
     }
-    out->lock = malloc(sizeof(pthread_mutex_t));
-    if(out->lock == NULL){
-        free(out);
+    out->offsets = (size_t*)(out->segments + segmentCount);
+    out->size = 0;
+    out->uncompressedSize = 0;
+    out->references = 1;
+    out->smallSegments = 0;
+    out->segmentCount = 0;
+    return out;
+}
+
+//Appends a segment to contents that are still being built, taking over the reference of the caller
+static void addSegment(FileContents* contents, FileSegment* segment){
+    contents->offsets[contents->segmentCount] = contents->uncompressedSize;
+    contents->segments[contents->segmentCount++] = segment;
+    contents->size += segment->size;
+    contents->uncompressedSize += segment->uncompressedSize;
+    if(segment->uncompressedSize < FILE_SEGMENT_COMPACTION_SIZE){
+        contents->smallSegments++;
+    }
+}
+
+//Appends a segment of other contents to contents that are still being built, sharing it
+static void shareSegment(FileContents* contents, FileSegment* segment){
+    __atomic_add_fetch(&(segment->references), 1, __ATOMIC_RELAXED);
+    addSegment(contents, segment);
+}
+
+//Fills in the sizes and the offsets of an upload once all of its blocks have been added by uploadFileChunk, which can add
+//them in any order. Returns false, leaving the upload as it is, if any block is missing
+static bool sealFileUpload(FileContents* upload){
+    for(unsigned int i = 0; i < upload->segmentCount; i++){
+        if(upload->segments[i] == NULL){
+            return false;
+        }
+    }
+    unsigned int blockCount = upload->segmentCount;
+    upload->size = 0;
+    upload->uncompressedSize = 0;
+    upload->smallSegments = 0;
+    upload->segmentCount = 0;
+    for(unsigned int i = 0; i < blockCount; i++){
+        addSegment(upload, upload->segments[i]);
+    }
+    return true;
+}
+
+//Passes to the output of a FileRange the part of a chunk of the segment being streamed that falls in the range, stopping
+//the segment once the range ends
+static bool outputFileRange(const char* chunk, size_t size, void* argument){
+    FileRange* range = argument;
+    if(size <= range->skip){
+        range->skip -= size;
+        return true;
+    }
+    chunk += range->skip;
+    size -= range->skip;
+    range->skip = 0;
+    size_t rangeChunkSize = size < range->size ? size : range->size;
+    range->size -= rangeChunkSize;
+    if(!range->output(chunk, rangeChunkSize, range->argument)){
+        range->failed = true;
+        return false;
+    }
+    return range->size > 0;
+}
+
+//Decompresses consecutive segments in a single new segment, compressed again as a whole if compress is true, otherwise left
+//for compressFile to compress. Returns NULL if there's an error
+static FileSegment* mergeSegments(FileCache* fileCache, FileSegment** segments, unsigned int segmentCount, size_t size, bool compress){
+    char* data = allocateFileData(fileCache, size);
+    if(data == NULL){
         return NULL;
     }
-    if(pthread_mutex_init(out->lock, NULL)){
+    size_t offset = 0;
+    for(unsigned int i = 0; i < segmentCount; i++){
+        char* buffer = NULL;
+        size_t segmentSize = 0;
+        const char* segmentData = readFileSegment(segments[i], &buffer, &segmentSize);
+        if(segmentData == NULL){
+            releaseFileData(fileCache, data, size);
+            return NULL;
+        }
+        memcpy(data + offset, segmentData, segmentSize);
+        offset += segmentSize;
+        free(buffer);
+    }
+    FileSegment* out = compress ? compressFileSegment(fileCache, data, size) : NULL;
+    if(out != NULL){
+        releaseFileData(fileCache, data, size);
+        return out;
+    }
+    out = newFileSegment(fileCache, data, size, size, Uncompressed);
+    if(out != NULL && compress){
+        //Not worth compressing, there's no need for the compression pool to try again
+        out->compressionPending = false;
+    }
+    return out;
+}
+
+//Destructor of the file lists retired to the epoch domain
+static void freeRetiredFileList(void* fileList){
+    FileList* list = fileList;
+    freeFileList(&list);
+}
+
+//Raises the maximum storage used and number of files reached to the values passed, if they are higher. Compare-and-swap
+//loops are used since files in different shards can be stored concurrently
+static void updateMaxReached(FileCache* fileCache, unsigned long size, unsigned int fileNumber){
+    unsigned long maxSize = __atomic_load_n(&(fileCache->maxReached.size), __ATOMIC_RELAXED);
+    while(size > maxSize && !__atomic_compare_exchange_n(&(fileCache->maxReached.size), &maxSize, size, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    unsigned int maxFileNumber = __atomic_load_n(&(fileCache->maxReached.fileNumber), __ATOMIC_RELAXED);
+    while(fileNumber > maxFileNumber && !__atomic_compare_exchange_n(&(fileCache->maxReached.fileNumber), &maxFileNumber, fileNumber, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+//Returns the record holding a file
+static FileRecord* getFileRecord(CachedFile* file){
+    return (FileRecord*)((char*)file - offsetof(FileRecord, file));
+}
+
+//Releases what a file holds, without giving its record back to the slab
+static void disposeCachedFile(CachedFile* file){
+    //Readers that pinned the contents keep them alive until they're done
+    unpinFileContents(file->contents);
+    file->contents = NULL;
+    unpinFileContents(file->evictedContents);
+    file->evictedContents = NULL;
+    pthread_mutex_destroy(&(file->lock));
+}
+
+//Allocates a new file, not yet linked to any list, from the slabs of a shard. Returns its node in the file list
+static FileList* initCachedFile(FileCacheShard* shard, const char* filename){
+    size_t len = strnlen(filename, MAX_FILENAME_SIZE);
+    unsigned int sizeClass = 0;
+    while(fileRecordNameCapacities[sizeClass] < len + 1){
+        sizeClass++;
+    }
+    FileRecord* record = slabAllocate(&(shard->records[sizeClass]));
+    if(record == NULL){
+        return NULL;
+    }
+    record->slab = &(shard->records[sizeClass]);
+    CachedFile* out = &(record->file);
+    if(pthread_mutex_init(&(out->lock), NULL)){
         perror("Error while initializing lock for file");
-        free(out->lock);
-        free(out);
+        slabRelease(record->slab, record);
         return NULL;
     }
+    record->node.file = out;
+    record->node.next = NULL;
+    record->node.prev = NULL;
 
-    size_t len = strnlen(filename, MAX_FILENAME_SIZE);
-    out->filename = malloc(len + 1);
-    strncpy(out->filename, filename, len);
+    out->filename = record->filename;
+    memcpy(out->filename, filename, len);
     out->filename[len] = '\0';
     out->size = 0;
+    out->uncompressedSize = 0;
     out->contents = NULL;
+    out->evictedContents = NULL;
     out->lockedBy = -1;
+    out->reservedSize = 0;
     out->compression = Uncompressed;
-    out->lastAccessed = getTimeStamp();
-    return out;
+    out->detached = false;
+    out->heat = 0;
+    out->hot = false;
+    out->recencyList = NULL;
+    out->lessRecent = NULL;
+    out->moreRecent = NULL;
+    out->frequency = 0;
+    out->priority = 0;
+    out->heapIndex = GDSF_NOT_IN_HEAP;
+    out->clockIndex = 0;
+    out->referenced = 0;
+    return &(record->node);
 }
 
-static void removeFileFromList(FileCache* fileCache, FileList** fileList, const char* filename){
-    FileList* list = *fileList;
+//Links a file at the most recent end of a recency list. Has to be called with the recency lock held
+static void linkAsMostRecent(RecencyList* list, CachedFile* file){
+    file->recencyList = list;
+    file->lessRecent = list->mostRecent;
+    file->moreRecent = NULL;
+    if(list->mostRecent != NULL){
+        list->mostRecent->moreRecent = file;
+    }else{
+        list->leastRecent = file;
+    }
+    list->mostRecent = file;
+    list->length++;
+}
+
+//Unlinks a file from the recency list it's in, if any. Has to be called with the recency lock held
+static void unlinkFromRecencyList(CachedFile* file){
+    RecencyList* list = file->recencyList;
     if(list == NULL){
         return;
     }
-    if(strcmp(list->file->filename, filename) == 0){
-        //The file to remove is the head of the list
-        *fileList = list->next;
-        fileCache->current.size -= getFileSize(list->file);
-        fileCache->current.fileNumber--;
-        //Free the node by setting next to null and using the function to free an entire list
-        list->next = NULL;
-        freeFileList(&list);
+    if(file->lessRecent != NULL){
+        file->lessRecent->moreRecent = file->moreRecent;
+    }else{
+        list->leastRecent = file->moreRecent;
+    }
+    if(file->moreRecent != NULL){
+        file->moreRecent->lessRecent = file->lessRecent;
+    }else{
+        list->mostRecent = file->lessRecent;
+    }
+    list->length--;
+    file->recencyList = NULL;
+    file->lessRecent = NULL;
+    file->moreRecent = NULL;
+}
+
+//Key function for the ghost index
+static const char* ghostEntryKey(const void* entry){
+    return ((const GhostEntry*)entry)->filename;
+}
+
+//Removes a name from the ghost list it's in and from the ghost index. Has to be called with the recency lock held
+static void removeGhost(FileCache* fileCache, GhostEntry* ghost){
+    GhostList* list = ghost->list;
+    if(ghost->lessRecent != NULL){
+        ghost->lessRecent->moreRecent = ghost->moreRecent;
+    }else{
+        list->leastRecent = ghost->moreRecent;
+    }
+    if(ghost->moreRecent != NULL){
+        ghost->moreRecent->lessRecent = ghost->lessRecent;
+    }else{
+        list->mostRecent = ghost->lessRecent;
+    }
+    list->length--;
+    hashIndexRemove(&(fileCache->ghostIndex), ghost->filename);
+    free(ghost->filename);
+    free(ghost);
+}
+
+//Remembers the name of a file evicted by ARC in a ghost list, forgetting the oldest name if the list is full.
+//Has to be called with the recency lock held
+static void addGhost(FileCache* fileCache, GhostList* list, const char* filename){
+    GhostEntry* old = hashIndexGet(&(fileCache->ghostIndex), filename);
+    if(old != NULL){
+        removeGhost(fileCache, old);
+    }
+    GhostEntry* ghost = malloc(sizeof(GhostEntry));
+    if(ghost == NULL){
+        return;
+    }
+    ghost->filename = strdup(filename);
+    ghost->list = list;
+    if(ghost->filename == NULL || !hashIndexInsert(&(fileCache->ghostIndex), ghost)){
+        free(ghost->filename);
+        free(ghost);
         return;
     }
-    //The file to remove is not the head of the list
-    while(list->next != NULL){
-        if(strcmp(list->next->file->filename, filename) == 0){
-            FileList* tmp = list->next->next;
-            fileCache->current.size -= getFileSize(list->next->file);
-            fileCache->current.fileNumber--;
-            //Free the node by setting next to null and using the function to free an entire list
-            list->next->next = NULL;
-            freeFileList(&(list->next));
-            list->next = tmp;
+    ghost->lessRecent = list->mostRecent;
+    ghost->moreRecent = NULL;
+    if(list->mostRecent != NULL){
+        list->mostRecent->moreRecent = ghost;
+    }else{
+        list->leastRecent = ghost;
+    }
+    list->mostRecent = ghost;
+    list->length++;
+    if(list->length > fileCache->max.fileNumber){
+        removeGhost(fileCache, list->leastRecent);
+    }
+}
+
+//Returns whether a file can be evicted: it isn't locked by a client and it isn't fileToExclude, which can be NULL
+static bool isEvictable(CachedFile* file, const char* fileToExclude){
+    return file->lockedBy == -1 && (fileToExclude == NULL || strncmp(file->filename, fileToExclude, MAX_FILENAME_SIZE) != 0);
+}
+
+//Returns the least recent file of a recency list that can be evicted, skipping the files that are locked by a client
+//and the one with filename equal to fileToExclude, or NULL if there is none. Has to be called with the recency lock held
+static CachedFile* getLeastRecentEvictable(RecencyList* list, const char* fileToExclude){
+    CachedFile* candidate = list->leastRecent;
+    while(candidate != NULL && !isEvictable(candidate, fileToExclude)){
+        candidate = candidate->moreRecent;
+    }
+    return candidate;
+}
+
+//Adds a file to the CLOCK ring. Has to be called with the recency lock held
+static void clockRingAdd(FileCache* fileCache, CachedFile* file){
+    if(fileCache->clockLength == fileCache->clockCapacity){
+        size_t newCapacity = fileCache->clockCapacity == 0 ? CLOCK_RING_INITIAL_CAPACITY : 2 * fileCache->clockCapacity;
+        CachedFile** newRing = realloc(fileCache->clockRing, newCapacity * sizeof(CachedFile*));
+        if(newRing == NULL){
+            perror("Error while growing the CLOCK ring");
             return;
         }
-        list = list->next;
+        fileCache->clockRing = newRing;
+        fileCache->clockCapacity = newCapacity;
     }
+    file->clockIndex = fileCache->clockLength;
+    fileCache->clockRing[fileCache->clockLength++] = file;
 }
 
+//Removes a file from the CLOCK ring, moving the last file of the ring in its place so that the ring stays contiguous.
+//Has to be called with the recency lock held
+static void clockRingRemove(FileCache* fileCache, CachedFile* file){
+    size_t index = file->clockIndex;
+    if(index >= fileCache->clockLength || fileCache->clockRing[index] != file){
+        return;
+    }
+    CachedFile* last = fileCache->clockRing[--fileCache->clockLength];
+    fileCache->clockRing[index] = last;
+    last->clockIndex = index;
+    if(fileCache->clockHand >= fileCache->clockLength){
+        fileCache->clockHand = 0;
+    }
+}
 
-bool canFitNewData(FileCache* fileCache, const char* filename, size_t dataSize, bool append){
-	return (fileCache->current.size) - (append ? 0 : getFileSize(getFile(fileCache, filename))) + dataSize <= fileCache->max.size;
+//Sweeps the CLOCK hand over the ring, giving a second chance to the files that have been read since the last sweep by
+//clearing their reference bit, until it finds a file that hasn't been. Locked files and the one with filename equal to
+//fileToExclude are skipped. Returns NULL if no file can be evicted. Has to be called with the recency lock held
+static CachedFile* clockSweep(FileCache* fileCache, const char* fileToExclude){
+    //Two full turns are enough: after the first one, every evictable file has its reference bit cleared
+    for(size_t steps = 0; steps < 2 * fileCache->clockLength; steps++){
+        CachedFile* candidate = fileCache->clockRing[fileCache->clockHand];
+        fileCache->clockHand = (fileCache->clockHand + 1) % fileCache->clockLength;
+        if(!isEvictable(candidate, fileToExclude)){
+            continue;
+        }
+        if(__atomic_load_n(&(candidate->referenced), __ATOMIC_RELAXED)){
+            __atomic_store_n(&(candidate->referenced), 0, __ATOMIC_RELAXED);
+        }else{
+            return candidate;
+        }
+    }
+    return NULL;
 }
 
-bool canFitNewFile(FileCache* fileCache){
-	return fileCache->current.fileNumber < fileCache->max.fileNumber;
+//Estimated cost of bringing a file back once it has been evicted: a fixed cost for the request plus the transfer of the
+//uncompressed contents, with compressed files also having to be compressed again
+static double getRefetchCost(CachedFile* file){
+    double cost = 1.0 + getUncompressedSize(file) / GDSF_TRANSFER_UNIT;
+    return file->compression == Uncompressed ? cost : cost * GDSF_COMPRESSION_COST_FACTOR;
 }
 
-//Initializes a new CachedFile and adds it to the FileCache's FileList
-CachedFile* createFile(FileCache* fileCache, const char* filename){
-    CachedFile* newFile = initCachedFile(filename);
-    if(newFile == NULL){
-        return NULL;
+//Places a file at a position of the GDSF heap, keeping its heap index up to date
+static void gdsfHeapSet(FileCache* fileCache, size_t index, CachedFile* file){
+    fileCache->gdsfHeap[index] = file;
+    file->heapIndex = index;
+}
+
+//Moves the file at the position passed up or down the heap until the heap property is restored
+static void gdsfHeapFix(FileCache* fileCache, size_t index){
+    CachedFile** heap = fileCache->gdsfHeap;
+    CachedFile* file = heap[index];
+    while(index > 0 && heap[(index - 1) / 2]->priority > file->priority){
+        gdsfHeapSet(fileCache, index, heap[(index - 1) / 2]);
+        index = (index - 1) / 2;
     }
-    fileCache->current.fileNumber++;
-    if(fileCache->current.fileNumber > fileCache->maxReached.fileNumber){
-        fileCache->maxReached.fileNumber = fileCache->current.fileNumber;
+    while(2 * index + 1 < fileCache->gdsfHeapLength){
+        size_t child = 2 * index + 1;
+        if(child + 1 < fileCache->gdsfHeapLength && heap[child + 1]->priority < heap[child]->priority){
+            child++;
+        }
+        if(heap[child]->priority >= file->priority){
+            break;
+        }
+        gdsfHeapSet(fileCache, index, heap[child]);
+        index = child;
     }
-    addFile(&(fileCache->files), newFile);
-    return newFile;
+    gdsfHeapSet(fileCache, index, file);
 }
 
-bool fileExists(FileCache* fileCache, const char* filename){
-    return getFile(fileCache, filename) != NULL;
+//Computes the GDSF priority of a file from its frequency, refetch cost and stored size, and repositions it in the heap.
+//Has to be called with the recency lock held
+static void gdsfUpdatePriority(FileCache* fileCache, CachedFile* file){
+    size_t size = getFileSize(file);
+    file->priority = fileCache->gdsfInflation + file->frequency * getRefetchCost(file) / (size == 0 ? 1 : size);
+    if(file->heapIndex != GDSF_NOT_IN_HEAP){
+        gdsfHeapFix(fileCache, file->heapIndex);
+    }
 }
 
-void freeCachedFile(CachedFile* file){
-    if(file->contents != NULL) {
-        free(file->contents);
-        file->contents = NULL;
+//Adds a file to the GDSF heap. Has to be called with the recency lock held
+static void gdsfHeapPush(FileCache* fileCache, CachedFile* file){
+    if(fileCache->gdsfHeapLength == fileCache->gdsfHeapCapacity){
+        size_t newCapacity = fileCache->gdsfHeapCapacity == 0 ? GDSF_HEAP_INITIAL_CAPACITY : 2 * fileCache->gdsfHeapCapacity;
+        CachedFile** newHeap = realloc(fileCache->gdsfHeap, newCapacity * sizeof(CachedFile*));
+        if(newHeap == NULL){
+            perror("Error while growing the GDSF heap");
+            return;
+        }
+        fileCache->gdsfHeap = newHeap;
+        fileCache->gdsfHeapCapacity = newCapacity;
+    }
+    gdsfHeapSet(fileCache, fileCache->gdsfHeapLength++, file);
+    gdsfHeapFix(fileCache, file->heapIndex);
+}
+
+//Removes a file from the GDSF heap, if it's in it. Has to be called with the recency lock held
+static void gdsfHeapRemove(FileCache* fileCache, CachedFile* file){
+    size_t index = file->heapIndex;
+    if(index == GDSF_NOT_IN_HEAP){
+        return;
     }
-    if(file->filename != NULL) {
-        free(file->filename);
-        file->filename = NULL;
+    file->heapIndex = GDSF_NOT_IN_HEAP;
+    CachedFile* last = fileCache->gdsfHeap[--fileCache->gdsfHeapLength];
+    if(last != file){
+        gdsfHeapSet(fileCache, index, last);
+        gdsfHeapFix(fileCache, index);
     }
-    free(file->lock);
-    file->lock = NULL;
-    free(file);
-    file = NULL;
 }
 
-void freeFileCache(FileCache** fileCache){
-    freeFileList(&((*fileCache)->files));
-    free(*fileCache);
-    *fileCache = NULL;
+//Returns the evictable file with the lowest GDSF priority, skipping the files that are locked by a client and the one
+//with filename equal to fileToExclude, or NULL if there is none. The heap is explored in priority order from the root,
+//so the cost depends on the number of files skipped rather than on the number of files cached.
+//Has to be called with the recency lock held
+static CachedFile* gdsfLowestEvictable(FileCache* fileCache, const char* fileToExclude){
+    CachedFile** heap = fileCache->gdsfHeap;
+    if(fileCache->gdsfHeapLength == 0){
+        return NULL;
+    }
+    if(isEvictable(heap[0], fileToExclude)){
+        return heap[0];
+    }
+    //Frontier of heap positions still to be visited, kept as a min-heap on the priority of the files at those positions
+    size_t* frontier = malloc(fileCache->gdsfHeapLength * sizeof(size_t));
+    if(frontier == NULL){
+        return NULL;
+    }
+    size_t frontierLength = 0;
+    size_t visiting = 0;
+    CachedFile* out = NULL;
+    while(true){
+        for(size_t child = 2 * visiting + 1; child <= 2 * visiting + 2 && child < fileCache->gdsfHeapLength; child++){
+            size_t i = frontierLength++;
+            while(i > 0 && heap[frontier[(i - 1) / 2]]->priority > heap[child]->priority){
+                frontier[i] = frontier[(i - 1) / 2];
+                i = (i - 1) / 2;
+            }
+            frontier[i] = child;
+        }
+        if(frontierLength == 0){
+            break;
+        }
+        visiting = frontier[0];
+        size_t last = frontier[--frontierLength];
+        size_t i = 0;
+        while(2 * i + 1 < frontierLength){
+            size_t child = 2 * i + 1;
+            if(child + 1 < frontierLength && heap[frontier[child + 1]]->priority < heap[frontier[child]]->priority){
+                child++;
+            }
+            if(heap[frontier[child]]->priority >= heap[last]->priority){
+                break;
+            }
+            frontier[i] = frontier[child];
+            i = child;
+        }
+        frontier[i] = last;
+        CachedFile* candidate = heap[visiting];
+        if(isEvictable(candidate, fileToExclude)){
+            out = candidate;
+            break;
+        }
+    }
+    free(frontier);
+    return out;
 }
 
-size_t getUncompressedSize(CachedFile* file){
-    return file->compression == Uncompressed ? file->size : file->uncompressedSize;
+//Places a newly created file in the recency lists. With ARC, a file whose name is in a ghost list was evicted too early:
+//the target size of the recent list is adapted in favour of the list it was evicted from, and the file counts as frequent
+static void onFileCreated(FileCache* fileCache, CachedFile* file){
+    switch(fileCache->cacheAlgorithm){
+        case FIFO:
+        case LRU:{
+            pthread_mutex_lock(&(fileCache->recencyLock));
+            linkAsMostRecent(&(fileCache->recent), file);
+            pthread_mutex_unlock(&(fileCache->recencyLock));
+            break;
+        }
+        case ARC:{
+            pthread_mutex_lock(&(fileCache->recencyLock));
+            GhostEntry* ghost = hashIndexGet(&(fileCache->ghostIndex), file->filename);
+            if(ghost == NULL){
+                linkAsMostRecent(&(fileCache->recent), file);
+            }else{
+                unsigned int recentGhosts = fileCache->recentGhosts.length;
+                unsigned int frequentGhosts = fileCache->frequentGhosts.length;
+                if(ghost->list == &(fileCache->recentGhosts)){
+                    unsigned int delta = frequentGhosts > recentGhosts ? frequentGhosts / recentGhosts : 1;
+                    fileCache->arcTarget += delta;
+                    if(fileCache->arcTarget > fileCache->max.fileNumber){
+                        fileCache->arcTarget = fileCache->max.fileNumber;
+                    }
+                }else{
+                    unsigned int delta = recentGhosts > frequentGhosts ? recentGhosts / frequentGhosts : 1;
+                    fileCache->arcTarget = fileCache->arcTarget > delta ? fileCache->arcTarget - delta : 0;
+                }
+                removeGhost(fileCache, ghost);
+                linkAsMostRecent(&(fileCache->frequent), file);
+            }
+            pthread_mutex_unlock(&(fileCache->recencyLock));
+            break;
+        }
+        case CLOCK:{
+            pthread_mutex_lock(&(fileCache->recencyLock));
+            clockRingAdd(fileCache, file);
+            pthread_mutex_unlock(&(fileCache->recencyLock));
+            break;
+        }
+        case GDSF:{
+            pthread_mutex_lock(&(fileCache->recencyLock));
+            file->frequency = 1;
+            gdsfUpdatePriority(fileCache, file);
+            gdsfHeapPush(fileCache, file);
+            pthread_mutex_unlock(&(fileCache->recencyLock));
+            break;
+        }
+        default:{
+            break;
+        }
+    }
 }
 
-CachedFile* getFile(FileCache* fileCache, const char* filename){
-    FileList* current = fileCache->files;
-    while(current != NULL){
-        if(strncmp(current->file->filename, filename, MAX_FILENAME_SIZE) == 0){
-            return current->file;
+//Records an access to a file: LRU moves it to the most recent end of its list, ARC promotes it to the frequent list,
+//GDSF raises its priority, CLOCK sets its reference bit
+static void onFileAccessed(FileCache* fileCache, CachedFile* file){
+    if(fileCache->cacheAlgorithm == CLOCK){
+        //No lock needed, and the bit is only written if it's not already set, to avoid writing to a shared cache line on every read
+        if(!__atomic_load_n(&(file->referenced), __ATOMIC_RELAXED)){
+            __atomic_store_n(&(file->referenced), 1, __ATOMIC_RELAXED);
         }
-        current = current->next;
+        return;
     }
-    return NULL;
+    if(fileCache->cacheAlgorithm == GDSF){
+        pthread_mutex_lock(&(fileCache->recencyLock));
+        file->frequency++;
+        gdsfUpdatePriority(fileCache, file);
+        pthread_mutex_unlock(&(fileCache->recencyLock));
+        return;
+    }
+    if(fileCache->cacheAlgorithm != LRU && fileCache->cacheAlgorithm != ARC){
+        return;
+    }
+    RecencyList* destination = fileCache->cacheAlgorithm == ARC ? &(fileCache->frequent) : &(fileCache->recent);
+    pthread_mutex_lock(&(fileCache->recencyLock));
+    if(file->recencyList != NULL && !(file->recencyList == destination && destination->mostRecent == file)){
+        unlinkFromRecencyList(file);
+        linkAsMostRecent(destination, file);
+    }
+    pthread_mutex_unlock(&(fileCache->recencyLock));
 }
 
-//Returns the first file found that is locked by the client, or NULL if none is found.
-//Used when a client disconnects to unlock all files locked by it
-CachedFile* getFileLockedByClient(FileCache* fileCache, int clientFd){
-    FileList* current = fileCache->files;
-    while(current != NULL){
-        if(current->file->lockedBy == clientFd){
-            return current->file;
+//Updates the bookkeeping of the caching algorithm for a file that has been chosen to be evicted.
+//Has to be called with the recency lock held
+static void onFileEvicted(FileCache* fileCache, CachedFile* victim){
+    if(fileCache->cacheAlgorithm == ARC){
+        addGhost(fileCache, victim->recencyList == &(fileCache->recent) ? &(fileCache->recentGhosts) : &(fileCache->frequentGhosts), victim->filename);
+    }else if(fileCache->cacheAlgorithm == GDSF){
+        //Files cached from now on start from the priority of the victim, so that files that are no longer accessed
+        //eventually fall behind them
+        fileCache->gdsfInflation = victim->priority;
+    }
+    __atomic_add_fetch(&(fileCache->filesEvicted), 1, __ATOMIC_RELAXED);
+}
+
+//Updates the owners of the segments of contents being installed in a file or removed from it, returning the change in the
+//storage used: segments shared by several files are only counted once, by the first file that installs them
+static long updateSegmentOwners(FileContents* contents, bool install){
+    long delta = 0;
+    for(unsigned int i = 0; contents != NULL && i < contents->segmentCount; i++){
+        FileSegment* segment = contents->segments[i];
+        if(install && __atomic_fetch_add(&(segment->owners), 1, __ATOMIC_RELAXED) == 0){
+            delta += segment->size;
+        }else if(!install && __atomic_sub_fetch(&(segment->owners), 1, __ATOMIC_RELAXED) == 0){
+            delta -= segment->size;
         }
-        current = current->next;
     }
-    return NULL;
+    return delta;
 }
 
-size_t getFileSize(CachedFile* file){
-    return file->size;
+//Unlinks the node of a file from the list of files of its shard and from the structures of the caching algorithm, using
+//the index to find it without scanning the list. Returns the node, which the caller has to free, or NULL if the file
+//doesn't exist. The contents stop being counted in the storage used, so they're dropped right away instead of when the record
+//is freed, which readers still inside the epoch can delay: readers that pinned them keep them until they're done, the
+//others find a detached file without contents. If evictedContents isn't NULL, the pin of the file is handed to the caller
+//through it instead. Has to be called with the lock of the shard held for writing and with the lock of the file held, so that
+//its contents can't change while they're being subtracted from the storage used
+static FileList* detachFile(FileCache* fileCache, FileCacheShard* shard, const char* filename, FileContents** evictedContents){
+    FileList* node = hashIndexRemove(&(shard->index), filename);
+    if(node == NULL){
+        return NULL;
+    }
+    if(node->prev != NULL){
+        node->prev->next = node->next;
+    }else{
+        shard->files = node->next;
+    }
+    if(node->next != NULL){
+        node->next->prev = node->prev;
+    }
+    if(fileCache->cacheAlgorithm == FIFO || fileCache->cacheAlgorithm == LRU || fileCache->cacheAlgorithm == ARC){
+        pthread_mutex_lock(&(fileCache->recencyLock));
+        unlinkFromRecencyList(node->file);
+        pthread_mutex_unlock(&(fileCache->recencyLock));
+    }else if(fileCache->cacheAlgorithm == GDSF){
+        pthread_mutex_lock(&(fileCache->recencyLock));
+        gdsfHeapRemove(fileCache, node->file);
+        pthread_mutex_unlock(&(fileCache->recencyLock));
+    }else if(fileCache->cacheAlgorithm == CLOCK){
+        pthread_mutex_lock(&(fileCache->recencyLock));
+        clockRingRemove(fileCache, node->file);
+        pthread_mutex_unlock(&(fileCache->recencyLock));
+    }
+    __atomic_add_fetch(&(fileCache->current.size), updateSegmentOwners(node->file->contents, false), __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&(fileCache->logicalSize), getFileSize(node->file), __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&(fileCache->current.fileNumber), 1, __ATOMIC_RELAXED);
+    node->file->detached = true;
+    if(evictedContents != NULL){
+        *evictedContents = node->file->contents;
+    }else{
+        unpinFileContents(node->file->contents);
+    }
+    node->file->contents = NULL;
+    node->next = NULL;
+    node->prev = NULL;
+    return node;
 }
 
-//Returns the filename of the next file that has to be evicted according to the caching algorithm selected,
-//or NULL if no file can be evicted according to the policies implemented.
-//A file with filename equal to the argument passed is guaranteed not to be selected by the algorithm.
-const char* getFileToEvict(FileCache* fileCache, const char* fileToExclude){
-    FileList* current = fileCache->files;
+//Returns the next file that has to be evicted according to the caching algorithm selected, or NULL if no file can be evicted,
+//without updating any bookkeeping, so that it can also be used to peek at the victim. The only side effect is that the CLOCK
+//hand moves, which is harmless since the sweep only clears the reference bits of the files it passes.
+//Has to be called with the recency lock held
+static CachedFile* selectFileToEvict(FileCache* fileCache, const char* fileToExclude){
     switch (fileCache->cacheAlgorithm) {
         default:
-        case FIFO:{
-            if(current == NULL){
-                return NULL;
+        case FIFO:
+        case LRU:{
+            //Walk the recency list starting from the least recently inserted or used file,
+            //skipping locked files and the file specified as parameter
+            return getLeastRecentEvictable(&(fileCache->recent), fileToExclude);
+        }
+        case ARC:{
+            //Evict from the recent list while it's bigger than its target size, from the frequent list otherwise.
+            //If the preferred list has no file that can be evicted, fall back to the other one
+            RecencyList* recent = &(fileCache->recent);
+            RecencyList* frequent = &(fileCache->frequent);
+            bool preferRecent = recent->length > 0 && (recent->length > fileCache->arcTarget || frequent->length == 0);
+            CachedFile* candidate = getLeastRecentEvictable(preferRecent ? recent : frequent, fileToExclude);
+            if(candidate == NULL){
+                candidate = getLeastRecentEvictable(preferRecent ? frequent : recent, fileToExclude);
             }
-            if(strcmp(current->file->filename, fileToExclude) == 0){
-                current = current->next;
-                if(current == NULL){
-                    return NULL;
+            return candidate;
+        }
+        case GDSF:{
+            return gdsfLowestEvictable(fileCache, fileToExclude);
+        }
+        case CLOCK:{
+            return clockSweep(fileCache, fileToExclude);
+        }
+    }
+}
+
+//Swaps new contents in, releasing the previous ones, and updates the storage used. Has to be called with the lock of the file held
+static void replaceFileContents(FileCache* fileCache, CachedFile* file, FileContents* contents){
+    size_t oldSize = getFileSize(file);
+    //The new contents are installed first, so that the segments they share with the old ones stay counted.
+    //Detached files are no longer counted, neither is what's written to them by the requests that found them before
+    long delta = file->detached ? 0 : updateSegmentOwners(contents, true) + updateSegmentOwners(file->contents, false);
+    unpinFileContents(file->contents);
+    file->contents = contents;
+    file->size = contents->size;
+    file->uncompressedSize = contents->uncompressedSize;
+    file->compression = Uncompressed;
+    for(unsigned int i = 0; i < contents->segmentCount; i++){
+        if(contents->segments[i]->compression != Uncompressed){
+            file->compression = contents->segments[i]->compression;
+        }
+    }
+
+    //A single atomic update, the difference wraps around correctly when the file shrinks
+    if(!file->detached){
+        unsigned long currentSize = __atomic_add_fetch(&(fileCache->current.size), delta, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&(fileCache->logicalSize), file->size - oldSize, __ATOMIC_RELAXED);
+        updateMaxReached(fileCache, currentSize, 0);
+    }
+
+    //The priority of GDSF depends on the size of the file
+    if(fileCache->cacheAlgorithm == GDSF){
+        pthread_mutex_lock(&(fileCache->recencyLock));
+        gdsfUpdatePriority(fileCache, file);
+        pthread_mutex_unlock(&(fileCache->recencyLock));
+    }
+}
+
+//Initializes a new CachedFile and adds it to the FileList of its shard. If upload isn't NULL, its contents are stored in the
+//file, as by storeFileUpload, before the shard is unlocked, so that the file can't be evicted before it holds them.
+//Returns NULL if the file already exists, in which case the upload is left to the caller
+static CachedFile* insertFile(FileCache* fileCache, const char* filename, FileContents* upload){
+    FileCacheShard* shard = getShard(fileCache, filename);
+    FileList* node = initCachedFile(shard, filename);
+    if(node == NULL){
+        return NULL;
+    }
+    CachedFile* newFile = node->file;
+    pthread_rwlock_wrlock(&(shard->lock));
+    addFile(&(shard->files), node);
+    if(!hashIndexInsert(&(shard->index), node)){
+        //The file already exists, or the index couldn't grow
+        shard->files = node->next;
+        if(node->next != NULL){
+            node->next->prev = NULL;
+        }
+        pthread_rwlock_unlock(&(shard->lock));
+        node->next = NULL;
+        freeFileList(&node);
+        return NULL;
+    }
+    unsigned int fileNumber = __atomic_add_fetch(&(fileCache->current.fileNumber), 1, __ATOMIC_RELAXED);
+    updateMaxReached(fileCache, 0, fileNumber);
+    onFileCreated(fileCache, newFile);
+    if(upload != NULL){
+        pthread_mutex_lock(&(newFile->lock));
+        storeFileUpload(fileCache, newFile, upload, false);
+        pthread_mutex_unlock(&(newFile->lock));
+    }
+    pthread_rwlock_unlock(&(shard->lock));
+    return newFile;
+}
+
+
+
+//Admission filter: when the cache is full, a new file is only worth storing if it's estimated to be accessed more often than
+//the file that would be evicted to make room for it. Returns true if the filter is disabled or there is nothing to compare against
+bool admitFile(FileCache* fileCache, const char* filename){
+    if(fileCache->admissionSketch == NULL){
+        return true;
+    }
+    pthread_mutex_lock(&(fileCache->recencyLock));
+    CachedFile* victim = selectFileToEvict(fileCache, filename);
+    bool admitted = victim == NULL || frequencySketchEstimate(fileCache->admissionSketch, filename) > frequencySketchEstimate(fileCache->admissionSketch, victim->filename);
+    pthread_mutex_unlock(&(fileCache->recencyLock));
+    if(!admitted){
+        __atomic_add_fetch(&(fileCache->filesRejected), 1, __ATOMIC_RELAXED);
+    }
+    return admitted;
+}
+
+//Allocates a buffer for size bytes of file contents, to be passed to storeFile or to releaseFileData. Returns NULL if there's
+//no memory left
+char* allocateFileData(FileCache* fileCache, size_t size){
+    return contentAllocatorAllocate(fileCache->contentAllocator, size);
+}
+
+//Appends data to a file as a new segment, so that only the data appended has to be compressed later by compressFile, while
+//the segments already stored are shared with the previous contents. The data has to be allocated by allocateFileData for size bytes, and is owned
+//by the cache from now on. Returns the size the file is stored in, or 0 if there's an error. Has to be called with the lock
+//of the file held
+size_t appendToCachedFile(FileCache* fileCache, CachedFile* file, char* data, size_t size){
+    onFileAccessed(fileCache, file);
+    if(size == 0){
+        releaseFileData(fileCache, data, size);
+        return getFileSize(file);
+    }
+    FileContents* oldContents = file->contents;
+    unsigned int oldSegmentCount = oldContents == NULL ? 0 : oldContents->segmentCount;
+    FileSegment* segment = newFileSegment(fileCache, data, size, size, Uncompressed);
+    FileContents* newContents = segment == NULL ? NULL : newFileContents(oldSegmentCount + 1);
+    if(newContents == NULL){
+        perror("Error while appending to file");
+        releaseFileSegment(segment);
+        return 0;
+    }
+    for(unsigned int i = 0; i < oldSegmentCount; i++){
+        //Empty segments, left by writing an empty file, are dropped
+        if(oldContents->segments[i]->uncompressedSize > 0){
+            shareSegment(newContents, oldContents->segments[i]);
+        }
+    }
+    addSegment(newContents, segment);
+    replaceFileContents(fileCache, file, newContents);
+    return getFileSize(file);
+}
+
+//Allocates the contents a file of size bytes is received in, split in blocks of FILE_UPLOAD_CHUNK_SIZE bytes that are passed to
+//uploadFileChunk, and then to storeFileUpload, or to unpinFileContents if the upload fails. The blocks are compressed
+//independently, so they can be compressed in parallel and in any order. Returns NULL if there's no memory left
+FileContents* beginFileUpload(size_t size){
+    return beginFileRestore((size + FILE_UPLOAD_CHUNK_SIZE - 1) / FILE_UPLOAD_CHUNK_SIZE);
+}
+
+//Allocates the contents a file is restored in from segmentCount frames written by streamFileFrames, which are passed to
+//uploadFileFrame, and then to restoreFile or to unpinFileContents. Unlike the blocks of an upload, the frames can have
+//any size. Returns NULL if there's no memory left
+FileContents* beginFileRestore(unsigned int segmentCount){
+    FileContents* out = newFileContents(segmentCount);
+    if(out != NULL){
+        //Each segment has its slot, filled by uploadFileChunk or uploadFileFrame, while the sizes are only summed once all are stored
+        for(unsigned int i = 0; i < segmentCount; i++){
+            out->segments[i] = NULL;
+        }
+        out->segmentCount = segmentCount;
+    }
+    return out;
+}
+
+bool canFitNewData(FileCache* fileCache, const char* filename, size_t dataSize, bool append){
+	return __atomic_load_n(&(fileCache->current.size), __ATOMIC_RELAXED) - (append ? 0 : getFileSize(getFile(fileCache, filename))) + dataSize <= fileCache->max.size;
+}
+
+bool canFitNewFile(FileCache* fileCache){
+	return __atomic_load_n(&(fileCache->current.fileNumber), __ATOMIC_RELAXED) < fileCache->max.fileNumber;
+}
+
+//Merges the runs of consecutive small segments of a file, up to FILE_SEGMENT_COMPACTION_SIZE bytes each, so that a file grown
+//by many small appends isn't split in too many segments. The merged segments are built without holding the lock of the file,
+//and swapped in only if the file hasn't changed in the meantime. Returns true if the file has been compacted.
+//Has to be called without holding the lock of the file
+bool compactFile(FileCache* fileCache, CachedFile* file){
+    pthread_mutex_lock(&(file->lock));
+    FileContents* contents = file->detached || file->contents == NULL || file->contents->smallSegments < FILE_SEGMENTS_BEFORE_COMPACTION ? NULL : file->contents;
+    //The segments of hot files are merged without being compressed
+    bool hot = file->hot;
+    if(contents != NULL){
+        __atomic_add_fetch(&(contents->references), 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&(file->lock));
+    if(contents == NULL){
+        return false;
+    }
+
+    FileContents* compacted = newFileContents(contents->segmentCount);
+    bool merged = false;
+    unsigned int i = 0;
+    while(compacted != NULL && i < contents->segmentCount){
+        //Find the run of small segments starting from the current one
+        unsigned int end = i;
+        size_t runSize = 0;
+        while(end < contents->segmentCount && contents->segments[end]->uncompressedSize < FILE_SEGMENT_COMPACTION_SIZE && runSize + contents->segments[end]->uncompressedSize <= FILE_SEGMENT_COMPACTION_SIZE){
+            runSize += contents->segments[end]->uncompressedSize;
+            end++;
+        }
+        if(end - i < 2){
+            //Nothing to merge, the segment is shared as it is
+            shareSegment(compacted, contents->segments[i]);
+            i++;
+            continue;
+        }
+        FileSegment* segment = mergeSegments(fileCache, contents->segments + i, end - i, runSize, !hot);
+        if(segment == NULL){
+            unpinFileContents(compacted);
+            compacted = NULL;
+            break;
+        }
+        addSegment(compacted, segment);
+        merged = true;
+        i = end;
+    }
+
+    bool swapped = false;
+    if(compacted != NULL && merged){
+        pthread_mutex_lock(&(file->lock));
+        if(file->contents == contents && !file->detached){
+            replaceFileContents(fileCache, file, compacted);
+            compacted = NULL;
+            swapped = true;
+        }
+        pthread_mutex_unlock(&(file->lock));
+    }
+    unpinFileContents(compacted);
+    unpinFileContents(contents);
+    return swapped;
+}
+
+//Compresses the segments of a file that have been stored as received, so that writes never have to wait for the compression.
+//The compressed segments are built without holding the lock of the file, and swapped in only if the file hasn't changed in the
+//meantime: until then, the file takes up its uncompressed size in the cache. Returns true if the file has been compressed.
+//Has to be called without holding the lock of the file
+bool compressFile(FileCache* fileCache, CachedFile* file){
+    pthread_mutex_lock(&(file->lock));
+    //Hot files are kept uncompressed until they cool down
+    FileContents* contents = file->detached || file->hot ? NULL : file->contents;
+    if(contents != NULL){
+        __atomic_add_fetch(&(contents->references), 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&(file->lock));
+    if(contents == NULL){
+        return false;
+    }
+
+    FileContents* compressed = newFileContents(contents->segmentCount);
+    bool changed = false;
+    for(unsigned int i = 0; compressed != NULL && i < contents->segmentCount; i++){
+        FileSegment* segment = contents->segments[i];
+        FileSegment* compressedSegment = NULL;
+        if(__atomic_load_n(&(segment->compressionPending), __ATOMIC_RELAXED)){
+            //Another file with the same contents might have been compressed already
+            compressedSegment = segment->blobs == NULL ? NULL : findBlob(segment->blobs, segment->blobKey, segment->data, segment->size, segment);
+            if(compressedSegment == NULL){
+                compressedSegment = compressFileSegment(fileCache, segment->data, segment->size);
+                if(compressedSegment != NULL){
+                    replaceBlob(segment, compressedSegment);
                 }
             }
-            while(current->next != NULL){
-                //Skip locked files and the file specified as parameter
-                if(current->next->file->lockedBy != -1 || strcmp(current->next->file->filename, fileToExclude) == 0){
-                    if(current->next->next == NULL){
-                        break;
-                    }else{
-                        current = current->next->next;
-                    }
-                }else{
-                    current = current->next;
-                }
+            if(compressedSegment == NULL){
+                //Not worth compressing. The segment is shared as it is, with the flag cleared so that it isn't tried again,
+                //which is harmless for the contents that share it, as they only read its data
+                __atomic_store_n(&(segment->compressionPending), false, __ATOMIC_RELAXED);
             }
+        }
+        if(compressedSegment == NULL){
+            shareSegment(compressed, segment);
+        }else{
+            addSegment(compressed, compressedSegment);
+            changed = true;
+        }
+    }
+
+    bool swapped = false;
+    if(compressed != NULL && changed){
+        pthread_mutex_lock(&(file->lock));
+        if(file->contents == contents && !file->detached){
+            replaceFileContents(fileCache, file, compressed);
+            compressed = NULL;
+            swapped = true;
+        }
+        pthread_mutex_unlock(&(file->lock));
+    }
+    unpinFileContents(compressed);
+    unpinFileContents(contents);
+    return swapped;
+}
+
+//Initializes a new CachedFile and adds it to the FileList of its shard
+CachedFile* createFile(FileCache* fileCache, const char* filename){
+    return insertFile(fileCache, filename, NULL);
+}
+
+//Stores the compressed segments of a hot file uncompressed, so that its reads don't have to decompress them. The file only
+//grows if the cache stays within FILE_HOT_BUDGET_PERCENT of its capacity, so that the room needed by new files isn't taken.
+//The segments are decompressed without holding the lock of the file, and swapped in only if the file hasn't changed in the
+//meantime. Returns true if the file has been decompressed. Has to be called without holding the lock of the file
+bool decompressFile(FileCache* fileCache, CachedFile* file){
+    pthread_mutex_lock(&(file->lock));
+    FileContents* contents = file->detached || !file->hot || file->compression == Uncompressed ? NULL : file->contents;
+    if(contents != NULL){
+        __atomic_add_fetch(&(contents->references), 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&(file->lock));
+    if(contents == NULL){
+        return false;
+    }
+
+    size_t growth = contents->uncompressedSize - contents->size;
+    FileContents* decompressed = NULL;
+    if(__atomic_load_n(&(fileCache->current.size), __ATOMIC_RELAXED) + growth <= fileCache->max.size / 100 * FILE_HOT_BUDGET_PERCENT){
+        decompressed = newFileContents(contents->segmentCount);
+    }
+    for(unsigned int i = 0; decompressed != NULL && i < contents->segmentCount; i++){
+        FileSegment* segment = contents->segments[i];
+        if(segment->compression == Uncompressed){
+            shareSegment(decompressed, segment);
+            continue;
+        }
+        FileSegment* decompressedSegment = mergeSegments(fileCache, &segment, 1, segment->uncompressedSize, false);
+        if(decompressedSegment == NULL){
+            unpinFileContents(decompressed);
+            decompressed = NULL;
+            break;
+        }
+        addSegment(decompressed, decompressedSegment);
+    }
+
+    bool swapped = false;
+    if(decompressed != NULL){
+        pthread_mutex_lock(&(file->lock));
+        if(file->contents == contents && !file->detached && file->hot){
+            replaceFileContents(fileCache, file, decompressed);
+            decompressed = NULL;
+            swapped = true;
+        }
+        pthread_mutex_unlock(&(file->lock));
+    }
+    unpinFileContents(decompressed);
+    unpinFileContents(contents);
+    return swapped;
+}
 
-            //If all the files are locked, then current->file will point to a locked file. We don't want to remove it
-            if(current->file->lockedBy == -1){
-                fileCache->filesEvicted++;
-                return current->file->filename;
+//Detaches from the cache, in a single pass of the caching algorithm, the files that have to be evicted to make room for
+//bytesNeeded more bytes and filesNeeded more files, never choosing locked files or the one with filename equal to fileToExclude,
+//which can be NULL if any file can be chosen.
+//The victims are returned as a list that the caller has to free once their contents have been sent, which are kept pinned
+//in evictedContents since the victims are detached. If the algorithm runs out
+//of files that can be evicted before enough room is made, the files detached until then are returned all the same.
+//Victims can be in any shard: each one is chosen under the recency lock, which is released before locking its shard,
+//so its name is copied and the victim is looked up again once the shard is locked. If another request has removed or
+//locked it in the meantime, the next victim is chosen instead
+FileList* detachFilesToEvict(FileCache* fileCache, const char* fileToExclude, size_t bytesNeeded, unsigned int filesNeeded){
+    FileList* victims = NULL;
+    FileList* lastVictim = NULL;
+    char victimName[MAX_FILENAME_SIZE];
+    while(__atomic_load_n(&(fileCache->current.size), __ATOMIC_RELAXED) + bytesNeeded > fileCache->max.size || __atomic_load_n(&(fileCache->current.fileNumber), __ATOMIC_RELAXED) + filesNeeded > fileCache->max.fileNumber){
+        pthread_mutex_lock(&(fileCache->recencyLock));
+        CachedFile* victim = selectFileToEvict(fileCache, fileToExclude);
+        if(victim != NULL){
+            strncpy(victimName, victim->filename, MAX_FILENAME_SIZE - 1);
+            victimName[MAX_FILENAME_SIZE - 1] = '\0';
+        }
+        pthread_mutex_unlock(&(fileCache->recencyLock));
+        if(victim == NULL){
+            break;
+        }
+
+        FileCacheShard* shard = getShard(fileCache, victimName);
+        pthread_rwlock_wrlock(&(shard->lock));
+        FileList* node = hashIndexGet(&(shard->index), victimName);
+        if(node != NULL){
+            CachedFile* file = node->file;
+            pthread_mutex_lock(&(file->lock));
+            if(file->lockedBy == -1){
+                pthread_mutex_lock(&(fileCache->recencyLock));
+                onFileEvicted(fileCache, file);
+                pthread_mutex_unlock(&(fileCache->recencyLock));
+                node = detachFile(fileCache, shard, victimName, &(file->evictedContents));
             }else{
-                return NULL;
+                node = NULL;
             }
+            pthread_mutex_unlock(&(file->lock));
+        }
+        pthread_rwlock_unlock(&(shard->lock));
+        if(node == NULL){
+            continue;
+        }
+        if(lastVictim == NULL){
+            victims = node;
+        }else{
+            lastVictim->next = node;
+        }
+        lastVictim = node;
+    }
+    return victims;
+}
+
+bool fileExists(FileCache* fileCache, const char* filename){
+    return getFile(fileCache, filename) != NULL;
+}
+
+//Returns whether the compaction of a file should be requested, which happens every FILE_SEGMENTS_BEFORE_COMPACTION small
+//segments, so that a file that keeps being appended to while a compaction is pending isn't requested again after each append.
+//Has to be called with the lock of the file held
+bool fileNeedsCompaction(CachedFile* file){
+    return file->contents != NULL && file->contents->smallSegments > 0 && file->contents->smallSegments % FILE_SEGMENTS_BEFORE_COMPACTION == 0;
+}
+
+//Returns whether any segment of a file is waiting to be compressed by compressFile. Usually it's the data last written, but
+//deduplication can share a segment that hasn't been compressed yet anywhere in a file. Has to be called with the lock of the
+//file held
+bool fileNeedsCompression(CachedFile* file){
+    for(unsigned int i = 0; file->contents != NULL && i < file->contents->segmentCount; i++){
+        if(__atomic_load_n(&(file->contents->segments[i]->compressionPending), __ATOMIC_RELAXED)){
+            return true;
         }
+    }
+    return false;
+}
+
+//Frees a file, together with its node in the file list, which is in the same record
+void freeCachedFile(CachedFile* file){
+    disposeCachedFile(file);
+    FileRecord* record = getFileRecord(file);
+    slabRelease(record->slab, record);
+}
+
+void freeFileCache(FileCache** fileCache){
+    epochFree(&((*fileCache)->epoch));
+    for(unsigned int i = 0; i < (*fileCache)->shardCount; i++){
+        FileCacheShard* shard = &((*fileCache)->shards[i]);
+        //The records are not released one by one, the slabs are freed all at once
+        for(FileList* current = shard->files; current != NULL; current = current->next){
+            disposeCachedFile(current->file);
+        }
+        shard->files = NULL;
+        for(unsigned int j = 0; j < FILE_RECORD_SIZE_CLASSES; j++){
+            slabFree(&(shard->records[j]));
+        }
+        hashIndexFree(&(shard->index));
+        pthread_rwlock_destroy(&(shard->lock));
+    }
+    free((*fileCache)->shards);
+    while((*fileCache)->recentGhosts.leastRecent != NULL){
+        removeGhost(*fileCache, (*fileCache)->recentGhosts.leastRecent);
+    }
+    while((*fileCache)->frequentGhosts.leastRecent != NULL){
+        removeGhost(*fileCache, (*fileCache)->frequentGhosts.leastRecent);
+    }
+    hashIndexFree(&((*fileCache)->ghostIndex));
+    free((*fileCache)->gdsfHeap);
+    free((*fileCache)->clockRing);
+    pthread_mutex_destroy(&((*fileCache)->recencyLock));
+    frequencySketchFree(&((*fileCache)->admissionSketch));
+    //After the files, since releasing their segments removes them from the table
+    if((*fileCache)->blobs != NULL){
+        hashIndexFree(&((*fileCache)->blobs->index));
+        pthread_mutex_destroy(&((*fileCache)->blobs->lock));
+        free((*fileCache)->blobs);
+    }
+    //After the files too, since the segments compressed with a dictionary reference it
+    if((*fileCache)->dictionaries != NULL){
+        releaseCompressionDictionary((*fileCache)->dictionaries->current);
+        free((*fileCache)->dictionaries->samples);
+        pthread_mutex_destroy(&((*fileCache)->dictionaries->lock));
+        free((*fileCache)->dictionaries);
+    }
+    //Last, since freeing the files releases their contents to it
+    contentAllocatorFree(&((*fileCache)->contentAllocator));
+    free(*fileCache);
+    *fileCache = NULL;
+}
+
+//Frees all the nodes from a file list, together with their files. Done iteratively, so that long lists can't overflow the stack
+void freeFileList(FileList** fileList){
+    FileList* current = *fileList;
+    while(current != NULL){
+        FileList* next = current->next;
+        freeCachedFile(current->file);
+        current = next;
+    }
+    *fileList = NULL;
+}
+
+const char* getCacheAlgorithmName(CacheAlgorithm cacheAlgorithm){
+    switch(cacheAlgorithm){
         case LRU:{
-            char* filename = NULL;
-            uint64_t currentMinTimestamp = UINT64_MAX;
-            while(current != NULL){
-                //Exclude files that are locked by a client, that have filename equals to filetoexclude, or that have a
-                //last accessed timestamp more recent that the one we have currently selected
-                if(current->file->lockedBy == -1 && strncmp(current->file->filename, fileToExclude, MAX_FILENAME_SIZE) != 0 && current->file->lastAccessed < currentMinTimestamp){
-                    currentMinTimestamp = current->file->lastAccessed;
-                    filename = current->file->filename;
-                }
-                current = current->next;
-            }
-            if(filename != NULL){
-                fileCache->filesEvicted++;
-            }
-            return filename;
-            break;
+            return "LRU";
+        }
+        case ARC:{
+            return "ARC";
+        }
+        case GDSF:{
+            return "GDSF";
+        }
+        case CLOCK:{
+            return "CLOCK";
+        }
+        case FIFO:
+        default:{
+            return "FIFO";
         }
     }
 }
 
-FileCache* initFileCache(unsigned int maxFiles, unsigned long maxSize, CompressionAlgorithm compressionAlgorithm, CacheAlgorithm cacheAlgorithm){
+size_t getUncompressedSize(CachedFile* file){
+    return file->uncompressedSize;
+}
+
+//Looks a file up without taking any lock. When the cache has concurrent readers, this has to be called from inside a critical
+//section of its epoch domain, and the file returned stays valid until the critical section ends, even if it's removed or evicted
+CachedFile* getFile(FileCache* fileCache, const char* filename){
+    FileList* node = hashIndexGet(&(getShard(fileCache, filename)->index), filename);
+    return node == NULL ? NULL : node->file;
+}
+
+size_t getFileSize(CachedFile* file){
+    return file->size;
+}
+
+FileCache* initFileCache(unsigned int maxFiles, unsigned long maxSize, CompressionAlgorithm compressionAlgorithm, int compressionLevel, CacheAlgorithm cacheAlgorithm, bool admissionFilter, unsigned int shardCount, unsigned int readers, bool hugePages, bool deduplication, bool dictionaries){
 	FileCache* out = malloc(sizeof(FileCache));
+	if(out == NULL){
+		return NULL;
+	}
 	out->max.fileNumber = maxFiles;
 	out->max.size = maxSize;
 	out->current.size = 0;
 	out->current.fileNumber = 0;
+	out->logicalSize = 0;
 	out->maxReached.size = 0;
 	out->maxReached.fileNumber = 0;
 	out->filesEvicted = 0;
-	out->files = NULL;
+	out->filesRejected = 0;
+	out->shards = NULL;
+	out->shardCount = 0;
 	out->compressionAlgorithm = compressionAlgorithm;
+	out->compressionLevel = compressionLevel;
     out->cacheAlgorithm = cacheAlgorithm;
+    memset(&(out->recent), 0, sizeof(RecencyList));
+    memset(&(out->frequent), 0, sizeof(RecencyList));
+    memset(&(out->recentGhosts), 0, sizeof(GhostList));
+    memset(&(out->frequentGhosts), 0, sizeof(GhostList));
+    memset(&(out->ghostIndex), 0, sizeof(HashIndex));
+    out->arcTarget = 0;
+    out->gdsfHeap = NULL;
+    out->gdsfHeapLength = 0;
+    out->gdsfHeapCapacity = 0;
+    out->gdsfInflation = 0;
+    out->clockRing = NULL;
+    out->clockLength = 0;
+    out->clockCapacity = 0;
+    out->clockHand = 0;
+    out->admissionSketch = NULL;
+    memset(&(out->compressionStats), 0, sizeof(CompressionStatistics));
+    out->contentAllocator = NULL;
+    out->epoch = NULL;
+    out->blobs = NULL;
+    out->dictionaries = NULL;
+    if(pthread_mutex_init(&(out->recencyLock), NULL)){
+        perror("Error while initializing recency lock");
+        free(out);
+        return NULL;
+    }
+    //From here on, freeFileCache can clean up whatever has been initialized
+    out->contentAllocator = contentAllocatorInit(hugePages);
+    if(out->contentAllocator == NULL){
+        freeFileCache(&out);
+        return NULL;
+    }
+    if(readers > 0){
+        out->epoch = epochInit(readers);
+        if(out->epoch == NULL){
+            freeFileCache(&out);
+            return NULL;
+        }
+    }
+    size_t indexCapacity = maxFiles < FILE_INDEX_INITIAL_CAPACITY ? maxFiles : FILE_INDEX_INITIAL_CAPACITY;
+    if(!hashIndexInit(&(out->ghostIndex), cacheAlgorithm == ARC ? indexCapacity : 0, ghostEntryKey, NULL)){
+        freeFileCache(&out);
+        return NULL;
+    }
+    if(shardCount == 0){
+        shardCount = 1;
+    }
+    out->shards = malloc(shardCount * sizeof(FileCacheShard));
+    if(out->shards == NULL){
+        freeFileCache(&out);
+        return NULL;
+    }
+    for(; out->shardCount < shardCount; out->shardCount++){
+        FileCacheShard* shard = &(out->shards[out->shardCount]);
+        shard->files = NULL;
+        if(!hashIndexInit(&(shard->index), indexCapacity / shardCount, fileListNodeKey, out->epoch)){
+            freeFileCache(&out);
+            return NULL;
+        }
+        if(pthread_rwlock_init(&(shard->lock), NULL)){
+            perror("Error while initializing shard lock");
+            hashIndexFree(&(shard->index));
+            freeFileCache(&out);
+            return NULL;
+        }
+        for(unsigned int j = 0; j < FILE_RECORD_SIZE_CLASSES; j++){
+            if(!slabInit(&(shard->records[j]), sizeof(FileRecord) + fileRecordNameCapacities[j])){
+                while(j > 0){
+                    slabFree(&(shard->records[--j]));
+                }
+                pthread_rwlock_destroy(&(shard->lock));
+                hashIndexFree(&(shard->index));
+                freeFileCache(&out);
+                return NULL;
+            }
+        }
+    }
+    if(admissionFilter){
+        out->admissionSketch = frequencySketchInit(maxFiles);
+        if(out->admissionSketch == NULL){
+            freeFileCache(&out);
+            return NULL;
+        }
+    }
+    if(deduplication){
+        BlobTable* blobs = malloc(sizeof(BlobTable));
+        if(blobs == NULL){
+            freeFileCache(&out);
+            return NULL;
+        }
+        if(pthread_mutex_init(&(blobs->lock), NULL)){
+            perror("Error while initializing blob table lock");
+            free(blobs);
+            freeFileCache(&out);
+            return NULL;
+        }
+        //Lookups are done with the lock held, there's no need to retire the old tables to the epoch domain
+        if(!hashIndexInit(&(blobs->index), FILE_BLOB_INITIAL_CAPACITY, fileSegmentKey, NULL)){
+            pthread_mutex_destroy(&(blobs->lock));
+            free(blobs);
+            freeFileCache(&out);
+            return NULL;
+        }
+        blobs->hits = 0;
+        out->blobs = blobs;
+    }
+    //Dictionaries are only used by codecs, so they're left disabled if the files aren't compressed
+    if(dictionaries && compressionAlgorithm != Uncompressed){
+        DictionaryTrainer* trainer = malloc(sizeof(DictionaryTrainer));
+        char* samples = malloc(FILE_DICTIONARY_SAMPLES_SIZE);
+        if(trainer == NULL || samples == NULL){
+            free(trainer);
+            free(samples);
+            freeFileCache(&out);
+            return NULL;
+        }
+        if(pthread_mutex_init(&(trainer->lock), NULL)){
+            perror("Error while initializing dictionary trainer lock");
+            free(trainer);
+            free(samples);
+            freeFileCache(&out);
+            return NULL;
+        }
+        trainer->current = NULL;
+        trainer->samples = samples;
+        trainer->samplesSize = 0;
+        trainer->sampleCount = 0;
+        trainer->segmentsSinceTraining = 0;
+        trainer->training = false;
+        trainer->trained = 0;
+        out->dictionaries = trainer;
+    }
 	return out;
 }
 
-//Reads a cached file. If the file is not compressed, the contents of the buffer will be returned,
-//otherwise the file will be decompressed and then sent. If there's an error while decompressing the file, the buffer will be sent as-is.
-char* readCachedFile(CachedFile* file, char** buffer, size_t* size){
-    file->lastAccessed = getTimeStamp();
-	switch(file->compression){
-		case Miniz:{
-            //Attempt decompression
-			*size = file->uncompressedSize;
-			*buffer = malloc(file->uncompressedSize);
-			int decompressionResult = uncompress((unsigned char*)*buffer, size, (const unsigned char*)(file->contents), getFileSize(file));
-			if(decompressionResult != Z_OK){
-				//There has been an error, send the file buffer as is
-				free(*buffer);
-				*size = getFileSize(file);
-				*buffer = malloc(*size);
-				memcpy(*buffer, file->contents, *size);
-				return *buffer;
-			}else{
-				//Decompression successful
-				return *buffer;
-			}
-		}
-		case Uncompressed:
-		default:{
-            //The file is not compressed, send the contents of the buffer
-			*size = getFileSize(file);
-			*buffer = malloc(*size);
-			memcpy(*buffer, file->contents, *size);
-			return *buffer;
-		}
-	}
+//Returns the contents of a file, pinned so that they stay valid after the lock of the file is released, or NULL if the file
+//has never been written. The contents are shared with the cache without being copied, and their segments have to be read
+//with readFileSegment. Has to be called with the lock of the file held, and the contents have to be passed to
+//unpinFileContents once they have been sent
+FileContents* pinFileContents(FileCache* fileCache, CachedFile* file){
+    onFileAccessed(fileCache, file);
+    file->heat++;
+    if(file->contents != NULL){
+        __atomic_add_fetch(&(file->contents->references), 1, __ATOMIC_RELAXED);
+    }
+    return file->contents;
+}
+
+//Returns the uncompressed data of a segment, storing its size in *size. Compressed segments are decompressed in a new buffer,
+//stored in *buffer, that the caller has to free, while *buffer is set to NULL for the others. Returns NULL if the segment
+//can't be decompressed
+const char* readFileSegment(FileSegment* segment, char** buffer, size_t* size){
+    *buffer = NULL;
+    *size = segment->uncompressedSize;
+    if(segment->compression == Uncompressed){
+        return segment->data;
+    }
+    const Codec* codec = getCodec(segment->compression);
+    CompressionDictionary* dictionary = segment->dictionary;
+    *buffer = malloc(segment->uncompressedSize > 0 ? segment->uncompressedSize : 1);
+    if(*buffer == NULL || !(dictionary == NULL ? codec->decompress(segment->data, segment->size, *buffer, segment->uncompressedSize) : codec->decompressWithDictionary(dictionary->data, dictionary->size, segment->data, segment->size, *buffer, segment->uncompressedSize))){
+        free(*buffer);
+        *buffer = NULL;
+        return NULL;
+    }
+    return *buffer;
+}
+
+//Records a request for a file, existing or not, in the frequency sketch of the admission filter
+void recordFileAccess(FileCache* fileCache, const char* filename){
+    if(fileCache->admissionSketch != NULL){
+        frequencySketchIncrement(fileCache->admissionSketch, filename);
+    }
+}
+
+//Gives back the storage reserved for a file by reserveFileCapacity. Has to be called with the lock of the file held
+void releaseFileCapacity(FileCache* fileCache, CachedFile* file){
+    __atomic_sub_fetch(&(fileCache->current.size), file->reservedSize, __ATOMIC_RELAXED);
+    file->reservedSize = 0;
+}
+
+//Gives back a buffer allocated by allocateFileData for the same size, that hasn't been passed to storeFile
+void releaseFileData(FileCache* fileCache, char* data, size_t size){
+    contentAllocatorRelease(fileCache->contentAllocator, data, size);
 }
 
 void removeFileFromCache(FileCache* fileCache, const char* filename){
-	removeFileFromList(fileCache, &(fileCache->files), filename);
+	FileCacheShard* shard = getShard(fileCache, filename);
+	pthread_rwlock_wrlock(&(shard->lock));
+	FileList* node = hashIndexGet(&(shard->index), filename);
+	if(node != NULL){
+		pthread_mutex_lock(&(node->file->lock));
+		detachFile(fileCache, shard, filename, NULL);
+		pthread_mutex_unlock(&(node->file->lock));
+	}
+	pthread_rwlock_unlock(&(shard->lock));
+	retireFileList(fileCache, &node);
+}
+
+//Reserves size bytes of storage for the data a client is about to send to a file, counting them in the storage used until
+//they're released by releaseFileCapacity, so that concurrent writes to other files can't take the same free space.
+//Returns false, reserving nothing, if they don't fit. Has to be called with the lock of the file held
+bool reserveFileCapacity(FileCache* fileCache, CachedFile* file, size_t size){
+    unsigned long currentSize = __atomic_load_n(&(fileCache->current.size), __ATOMIC_RELAXED);
+    do{
+        if(currentSize + size > fileCache->max.size){
+            return false;
+        }
+    }while(!__atomic_compare_exchange_n(&(fileCache->current.size), &currentSize, currentSize + size, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    file->reservedSize += size;
+    return true;
+}
+
+//Adds a file read back from the disk tier to the cache, with the contents filled by uploadFileFrame, which are owned by the cache
+//from now on. Returns NULL if the file already exists or if there's no memory left, in which case the contents are left to the caller
+CachedFile* restoreFile(FileCache* fileCache, const char* filename, FileContents* contents){
+    return insertFile(fileCache, filename, contents);
+}
+
+//Frees a list of files detached from the cache, once no reader can still be using them
+void retireFileList(FileCache* fileCache, FileList** fileList){
+    if(*fileList != NULL){
+        epochRetire(fileCache->epoch, *fileList, freeRetiredFileList);
+        *fileList = NULL;
+    }
 }
 
-//Stored a buffer in a CachedFile. If the FileCache has been configured to compress the files,
-//then there will be an attempt at compressing the file. If the compression fails, or if the size of the compressed file
-//is equal or higher than that of the original file, the file will be stored non-compressed, for space and performance reasons.
+//Stored a buffer in a CachedFile, as a single segment replacing the previous contents of the file, which are freed once
+//the readers that pinned them are done. The buffer is stored as it is, compressFile compresses it later. With deduplication
+//enabled, if another file holds the same contents their segment is shared and the buffer is released, appending to either
+//file later leaves the other one untouched, since appends build new contents. The buffer has to be allocated by allocateFileData for size bytes, and is owned
+//by the cache from now on. Returns the size the file is stored in, or 0 if there's an error. Has to be called with the lock
+//of the file held
 size_t storeFile(FileCache* fileCache, CachedFile* file, char* contents, size_t size){
-    fileCache->current.size -= getFileSize(file);
-	file->lastAccessed = getTimeStamp();
-
-	switch(fileCache->compressionAlgorithm) {
-		case Miniz:{
-			//Miniz (zlib) compression
-			unsigned long compressedSize = compressBound(size);
-			char* compressedBuffer = malloc(compressedSize);
-			int compressionStatus = compress((unsigned char*)compressedBuffer, &compressedSize, (const unsigned char*)contents, size);
-			if(compressionStatus != Z_OK || compressedSize >= size){
-				//Error while compressing, or the compressed file is bigger or the same size
-				//as the non-compressed one. Save the file as non-compressed
-				free(compressedBuffer);
-				fileCache->current.size += size;
-				if(fileCache->current.size > fileCache->maxReached.size){
-					fileCache->maxReached.size = fileCache->current.size;
-				}
-				file->size = size;
-				file->contents = contents;
-				file->compression = Uncompressed;
-				return size;
-			}else{
-				//Compression successful
-				free(contents);
-				fileCache->current.size += compressedSize;
-				if(fileCache->current.size > fileCache->maxReached.size){
-					fileCache->maxReached.size = fileCache->current.size;
-				}
-				file->size = compressedSize;
-				file->uncompressedSize = size;
-				file->contents = compressedBuffer;
-				file->compression = Miniz;
-				return compressedSize;
-			}
-		}
-		case Uncompressed:
-		default:{
-			//Compression not enabled
-			fileCache->current.size += size;
-			if(fileCache->current.size > fileCache->maxReached.size){
-				fileCache->maxReached.size = fileCache->current.size;
-			}
-			file->size = size;
-			file->contents = contents;
-			file->compression = Uncompressed;
-			return size;
-		}
-	}
+    //Filling a newly created file is part of its insertion, only later writes count as accesses
+    if(getFileSize(file) != 0){
+        onFileAccessed(fileCache, file);
+    }
+    FileSegment* segment = NULL;
+    char key[FILE_BLOB_KEY_SIZE];
+    if(fileCache->blobs != NULL && size > 0){
+        //The segment of a file with the same contents is shared instead of storing them again
+        hashFileData(contents, size, key);
+        segment = findBlob(fileCache->blobs, key, contents, size, NULL);
+        if(segment != NULL){
+            releaseFileData(fileCache, contents, size);
+        }
+    }
+    if(segment == NULL){
+        segment = newFileSegment(fileCache, contents, size, size, Uncompressed);
+        if(segment != NULL && fileCache->blobs != NULL && size > 0){
+            addBlob(fileCache->blobs, segment, key);
+        }
+    }
+    FileContents* newContents = segment == NULL ? NULL : newFileContents(1);
+    if(newContents == NULL){
+        perror("Error while storing file");
+        releaseFileSegment(segment);
+        return 0;
+    }
+    addSegment(newContents, segment);
+    replaceFileContents(fileCache, file, newContents);
+    return getFileSize(file);
+}
+
+//Stores the contents received by an upload in a CachedFile, replacing its contents or appended to them. The segments of the
+//upload have already been compressed, so unlike storeFile and appendToCachedFile there's nothing left for compressFile to do.
+//All of its blocks have to have been stored by uploadFileChunk. The upload is owned by the cache from now on. Returns the size
+//the file is stored in, or 0 if there's an error. Has to be called with the lock of the file held
+size_t storeFileUpload(FileCache* fileCache, CachedFile* file, FileContents* upload, bool append){
+    if(!sealFileUpload(upload)){
+        unpinFileContents(upload);
+        return 0;
+    }
+    if(append || getFileSize(file) != 0){
+        onFileAccessed(fileCache, file);
+    }
+    FileContents* newContents = upload;
+    if(append && file->contents != NULL){
+        FileContents* oldContents = file->contents;
+        newContents = newFileContents(oldContents->segmentCount + upload->segmentCount);
+        for(unsigned int i = 0; newContents != NULL && i < oldContents->segmentCount; i++){
+            //Empty segments, left by writing an empty file, are dropped
+            if(oldContents->segments[i]->uncompressedSize > 0){
+                shareSegment(newContents, oldContents->segments[i]);
+            }
+        }
+        for(unsigned int i = 0; newContents != NULL && i < upload->segmentCount; i++){
+            shareSegment(newContents, upload->segments[i]);
+        }
+        unpinFileContents(upload);
+    }
+    if(newContents == NULL){
+        perror("Error while storing file");
+        return 0;
+    }
+    replaceFileContents(fileCache, file, newContents);
+    return getFileSize(file);
+}
+
+//Passes to output the uncompressed bytes of contents from offset to offset + size, decompressing only the segments that hold
+//them: the first one is found with a binary search on the offsets of the segments, and the last one is only decompressed
+//up to the end of the range. Contents received by a chunked upload are split in blocks of FILE_UPLOAD_CHUNK_SIZE bytes, so a
+//range of them costs at most two partial blocks besides the ones it covers. The contents can be NULL if size is 0. Returns
+//false if the range goes past the end of the contents, if a segment can't be decompressed or if output returns false
+bool streamFileRange(FileContents* contents, size_t offset, size_t size, CodecOutput output, void* argument){
+    if(size == 0){
+        return true;
+    }
+    if(contents == NULL || offset > contents->uncompressedSize || size > contents->uncompressedSize - offset){
+        return false;
+    }
+    //Last segment starting at or before offset
+    unsigned int first = 0;
+    unsigned int last = contents->segmentCount;
+    while(last - first > 1){
+        unsigned int middle = first + (last - first) / 2;
+        if(contents->offsets[middle] <= offset){
+            first = middle;
+        }else{
+            last = middle;
+        }
+    }
+    FileRange range = {offset - contents->offsets[first], size, false, output, argument};
+    for(unsigned int i = first; range.size > 0 && i < contents->segmentCount; i++){
+        if(!streamFileSegment(contents->segments[i], outputFileRange, &range) && (range.failed || range.size > 0)){
+            return false;
+        }
+    }
+    return true;
+}
+
+//Passes contents to output as a sequence of frames, one for each segment, each made of an FCPFrameHeader followed by its data.
+//The segments compressed with a codec in codecs, the set of FCP_CODEC_BIT of the algorithms the reader can decompress, are
+//passed as they are, unless they need a dictionary; the others are passed uncompressed, decompressed a window at a time by
+//streamFileSegment. Empty segments, left by writing an empty file, have no frame. The contents can be NULL. Returns false
+//if a segment can't be decompressed or if output returns false
+bool streamFileFrames(FileContents* contents, int32_t codecs, CodecOutput output, void* argument){
+    for(unsigned int i = 0; contents != NULL && i < contents->segmentCount; i++){
+        FileSegment* segment = contents->segments[i];
+        if(segment->uncompressedSize == 0){
+            continue;
+        }
+        bool verbatim = segment->compression != Uncompressed && segment->dictionary == NULL && (codecs & FCP_CODEC_BIT(segment->compression));
+        FCPFrameHeader header;
+        header.size = verbatim ? segment->size : segment->uncompressedSize;
+        header.uncompressedSize = segment->uncompressedSize;
+        header.compression = verbatim ? segment->compression : Uncompressed;
+        if(!output((const char*)&header, sizeof(FCPFrameHeader), argument)){
+            return false;
+        }
+        if(!(verbatim ? output(segment->data, segment->size, argument) : streamFileSegment(segment, output, argument))){
+            return false;
+        }
+    }
+    return true;
+}
+
+//Passes the uncompressed data of a segment to output, without decompressing it in a buffer as big as the segment if it's
+//larger than FILE_SEGMENT_STREAMING_SIZE bytes: its codec decompresses it a window at a time instead, so that the memory
+//needed to read a segment is bounded and the data starts being sent before the whole segment is decompressed. Returns false
+//if the segment can't be decompressed or if output returns false, possibly after passing part of the data to output
+bool streamFileSegment(FileSegment* segment, CodecOutput output, void* argument){
+    if(segment->compression != Uncompressed && segment->uncompressedSize > FILE_SEGMENT_STREAMING_SIZE){
+        CompressionDictionary* dictionary = segment->dictionary;
+        return getCodec(segment->compression)->decompressStream(dictionary == NULL ? NULL : dictionary->data, dictionary == NULL ? 0 : dictionary->size, segment->data, segment->size, segment->uncompressedSize, output, argument);
+    }
+    char* buffer = NULL;
+    size_t size = 0;
+    const char* data = readFileSegment(segment, &buffer, &size);
+    bool streamed = data != NULL && (size == 0 || output(data, size, argument));
+    free(buffer);
+    return streamed;
+}
+
+//Drops a reference to file contents, freeing them if it was the last one
+void unpinFileContents(FileContents* contents){
+    if(contents != NULL && __atomic_sub_fetch(&(contents->references), 1, __ATOMIC_ACQ_REL) == 0){
+        for(unsigned int i = 0; i < contents->segmentCount; i++){
+            releaseFileSegment(contents->segments[i]);
+        }
+        free(contents);
+    }
+}
+
+//Tiering pass, to be run periodically: files read at least FILE_HOT_HEAT times, with the reads of the previous passes counting
+//half as much at every pass, become hot, and are kept uncompressed by decompressFile. Hot files become cold again once their
+//heat falls under FILE_COLD_HEAT, and are compressed again by compressFile. The callback is called, with the lock of the shard
+//of the file held, with the name of the files that have to be passed to those functions: the ones that changed tier, and the
+//hot ones that are still compressed. Returns the number of hot files
+unsigned int updateFileTemperatures(FileCache* fileCache, void (*onTemperatureChange)(const char* filename)){
+    unsigned int hotFiles = 0;
+    for(unsigned int i = 0; i < fileCache->shardCount; i++){
+        FileCacheShard* shard = &(fileCache->shards[i]);
+        pthread_rwlock_rdlock(&(shard->lock));
+        for(FileList* current = shard->files; current != NULL; current = current->next){
+            CachedFile* file = current->file;
+            pthread_mutex_lock(&(file->lock));
+            //Different thresholds to become hot and cold, so that files don't change tier at every pass
+            bool hot = file->heat >= (file->hot ? FILE_COLD_HEAT : FILE_HOT_HEAT);
+            bool changed = hot != file->hot || (hot && file->compression != Uncompressed);
+            file->hot = hot;
+            file->heat /= 2;
+            pthread_mutex_unlock(&(file->lock));
+            if(hot){
+                hotFiles++;
+            }
+            if(changed){
+                onTemperatureChange(file->filename);
+            }
+        }
+        pthread_rwlock_unlock(&(shard->lock));
+    }
+    return hotFiles;
+}
+
+//Stores the block of index index of an upload started by beginFileUpload, compressed right away, so that the file is compressed
+//while it's received. Blocks that aren't worth compressing are stored as they are, and
+//with deduplication enabled a block already held by another segment shares it. Different blocks of the same upload can be
+//stored concurrently. The chunk has to be allocated by allocateFileData for size bytes, and is owned by the cache from now on.
+//Returns false if there's an error
+bool uploadFileChunk(FileCache* fileCache, FileContents* upload, unsigned int index, char* chunk, size_t size){
+    FileSegment* segment = NULL;
+    char key[FILE_BLOB_KEY_SIZE];
+    if(fileCache->blobs != NULL){
+        hashFileData(chunk, size, key);
+        segment = findBlob(fileCache->blobs, key, chunk, size, NULL);
+    }
+    if(segment == NULL){
+        segment = compressFileSegment(fileCache, chunk, size);
+        if(segment == NULL){
+            segment = newFileSegment(fileCache, chunk, size, size, Uncompressed);
+            chunk = NULL;
+            if(segment != NULL){
+                //Already found not worth compressing
+                segment->compressionPending = false;
+            }
+        }
+        if(segment != NULL && fileCache->blobs != NULL){
+            addBlob(fileCache->blobs, segment, key);
+        }
+    }
+    if(chunk != NULL){
+        releaseFileData(fileCache, chunk, size);
+    }
+    if(segment == NULL){
+        perror("Error while receiving file");
+        return false;
+    }
+    upload->segments[index] = segment;
+    return true;
+}
+
+//Stores the block of index index of an upload started by beginFileUpload as a client has sent it, in a frame of a compressed
+//transfer. Compressed frames are stored as they are, without compressing them again, after checking that they decompress to
+//uncompressedSize bytes, since a frame that doesn't would make every read of the file fail. Uncompressed frames are left to
+//compressFile, like the data written by storeFile, and are shared with deduplication enabled, while compressed ones aren't
+//indexed, since their key would have to be hashed from the uncompressed data. Different blocks of the same upload can be stored
+//concurrently. The data has to be allocated by allocateFileData for size bytes, and is owned by the cache from now on.
+//Returns false if there's an error or the frame is corrupt
+bool uploadFileFrame(FileCache* fileCache, FileContents* upload, unsigned int index, char* data, size_t size, size_t uncompressedSize, CompressionAlgorithm compression){
+    FileSegment* segment = NULL;
+    char key[FILE_BLOB_KEY_SIZE];
+    bool indexed = fileCache->blobs != NULL && compression == Uncompressed;
+    if(indexed){
+        hashFileData(data, size, key);
+        segment = findBlob(fileCache->blobs, key, data, size, NULL);
+        if(segment != NULL){
+            releaseFileData(fileCache, data, size);
+        }
+    }
+    if(segment == NULL){
+        segment = newFileSegment(fileCache, data, size, uncompressedSize, compression);
+        if(segment != NULL && compression != Uncompressed){
+            if(!isValidFrame(segment)){
+                releaseFileSegment(segment);
+                return false;
+            }
+        }
+        if(segment != NULL && indexed){
+            addBlob(fileCache->blobs, segment, key);
+        }
+    }
+    if(segment == NULL){
+        perror("Error while receiving file");
+        return false;
+    }
+    upload->segments[index] = segment;
+    return true;
 }
@@ -102,6 +102,18 @@ void clientListAdd(ClientList** list, int descriptor){
     current->next = newNode;
 }
 
+//Returns the codecs negotiated by a client, or 0 if it hasn't negotiated compressed transfers or isn't connected
+int32_t clientListGetCodecs(ClientList* list, int descriptor){
+    ClientList* current = list;
+    while(current != NULL){
+        if(current->descriptor == descriptor){
+            return current->codecs;
+        }
+        current = current->next;
+    }
+    return 0;
+}
+
 ConnectionStatus clientListGetStatus(ClientList* list, int descriptor){
     ClientList* current = list;
     while(current != NULL){
@@ -145,6 +157,17 @@ void clientListRemove(ClientList** list, int descriptor){
     current->next = tmp;
 }
 
+void clientListSetCodecs(ClientList* list, int descriptor, int32_t codecs){
+    ClientList* current = list;
+    while(current != NULL){
+        if(current->descriptor == descriptor){
+            current->codecs = codecs;
+            return;
+        }
+        current = current->next;
+    }
+}
+
 void clientListUpdateStatus(ClientList* list, int descriptor, ConnectionStatus status){
     ClientList* current = list;
     while(current != NULL){
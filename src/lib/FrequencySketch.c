@@ -0,0 +1,103 @@
+#include <malloc.h>
+#include <stdio.h>
+
+#include "../include/FrequencySketch.h"
+#include "../include/HashIndex.h"
+
+
+
+//Odd multipliers used to derive an independent index for each row from a single hash of the key
+static const uint32_t rowSeeds[FREQUENCY_SKETCH_DEPTH] = {0x9E3779B1u, 0x85EBCA77u, 0xC2B2AE3Du, 0x27D4EB2Fu};
+
+
+
+//Returns the counter of a row the key is mapped to
+static uint8_t* getCounter(FrequencySketch* sketch, uint32_t hash, int row){
+    uint32_t mixed = hash * rowSeeds[row];
+    mixed ^= mixed >> 15;
+    return &(sketch->counters[row * sketch->width + (mixed & (sketch->width - 1))]);
+}
+
+//Halves all the counters, so that keys that are no longer accessed lose weight against new ones
+static void age(FrequencySketch* sketch){
+    pthread_mutex_lock(&(sketch->agingLock));
+    //Another thread could have aged the sketch while this one was waiting for the lock
+    if(__atomic_load_n(&(sketch->additions), __ATOMIC_RELAXED) >= sketch->sampleSize){
+        for(size_t i = 0; i < FREQUENCY_SKETCH_DEPTH * sketch->width; i++){
+            uint8_t count = __atomic_load_n(&(sketch->counters[i]), __ATOMIC_RELAXED);
+            __atomic_store_n(&(sketch->counters[i]), count / 2, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&(sketch->additions), sketch->sampleSize / 2, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&(sketch->agingLock));
+}
+
+
+
+unsigned int frequencySketchEstimate(FrequencySketch* sketch, const char* key){
+    uint32_t hash = hashString(key);
+    unsigned int estimate = FREQUENCY_SKETCH_MAX_COUNT;
+    for(int row = 0; row < FREQUENCY_SKETCH_DEPTH; row++){
+        unsigned int count = __atomic_load_n(getCounter(sketch, hash, row), __ATOMIC_RELAXED);
+        if(count < estimate){
+            estimate = count;
+        }
+    }
+    return estimate;
+}
+
+void frequencySketchFree(FrequencySketch** sketch){
+    if(*sketch == NULL){
+        return;
+    }
+    pthread_mutex_destroy(&((*sketch)->agingLock));
+    free((*sketch)->counters);
+    free(*sketch);
+    *sketch = NULL;
+}
+
+//Records an occurrence of a key. Only the counters holding the current estimate are incremented (conservative update),
+//which limits the overestimation caused by collisions
+void frequencySketchIncrement(FrequencySketch* sketch, const char* key){
+    uint32_t hash = hashString(key);
+    unsigned int estimate = frequencySketchEstimate(sketch, key);
+    if(estimate < FREQUENCY_SKETCH_MAX_COUNT){
+        for(int row = 0; row < FREQUENCY_SKETCH_DEPTH; row++){
+            uint8_t* counter = getCounter(sketch, hash, row);
+            uint8_t count = __atomic_load_n(counter, __ATOMIC_RELAXED);
+            //If the counter has been changed concurrently the compare and swap fails, and the increment is left to the other thread
+            if(count == estimate){
+                __atomic_compare_exchange_n(counter, &count, count + 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+            }
+        }
+    }
+    if(__atomic_add_fetch(&(sketch->additions), 1, __ATOMIC_RELAXED) == sketch->sampleSize){
+        age(sketch);
+    }
+}
+
+//Creates a sketch sized to tell apart the frequencies of about expectedKeys keys
+FrequencySketch* frequencySketchInit(size_t expectedKeys){
+    FrequencySketch* out = malloc(sizeof(FrequencySketch));
+    if(out == NULL){
+        return NULL;
+    }
+    out->width = FREQUENCY_SKETCH_MIN_WIDTH;
+    while(out->width < expectedKeys){
+        out->width *= 2;
+    }
+    out->counters = calloc(FREQUENCY_SKETCH_DEPTH * out->width, sizeof(uint8_t));
+    if(out->counters == NULL){
+        free(out);
+        return NULL;
+    }
+    out->sampleSize = 10 * out->width;
+    out->additions = 0;
+    if(pthread_mutex_init(&(out->agingLock), NULL)){
+        perror("Error while initializing frequency sketch aging lock");
+        free(out->counters);
+        free(out);
+        return NULL;
+    }
+    return out;
+}
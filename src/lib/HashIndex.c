@@ -0,0 +1,158 @@
+#include <malloc.h>
+#include <string.h>
+
+#include "../include/HashIndex.h"
+
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+
+
+//Marks slots whose value has been removed, so that probe sequences passing through them are not interrupted
+static char tombstoneMarker;
+#define TOMBSTONE ((void*)&tombstoneMarker)
+
+
+
+//Allocates an empty table
+static HashIndexTable* allocateTable(size_t capacity){
+    HashIndexTable* table = calloc(1, sizeof(HashIndexTable) + capacity * sizeof(HashIndexSlot));
+    if(table == NULL){
+        return NULL;
+    }
+    table->capacity = capacity;
+    return table;
+}
+
+//Returns the slot holding the value with the key passed, storing the value in *value, or NULL if there is none. The value
+//of each slot is read once and before its hash, while writers publish the hash first, so that a lookup never matches
+//a half written slot, and the value returned is the one that matched even if the slot is concurrently emptied
+static HashIndexSlot* findSlot(HashIndexTable* table, HashIndexKeyFunction getKey, const char* key, uint32_t hash, void** value){
+    size_t mask = table->capacity - 1;
+    for(size_t i = hash & mask;; i = (i + 1) & mask){
+        HashIndexSlot* slot = &(table->slots[i]);
+        *value = __atomic_load_n(&(slot->value), __ATOMIC_ACQUIRE);
+        if(*value == NULL){
+            return NULL;
+        }
+        if(*value != TOMBSTONE && __atomic_load_n(&(slot->hash), __ATOMIC_RELAXED) == hash && strcmp(getKey(*value), key) == 0){
+            return slot;
+        }
+    }
+}
+
+//Places a value in the first free slot of its probe sequence, without checking for duplicates or resizing.
+//Returns true if the slot was a tombstone
+static bool placeValue(HashIndexTable* table, uint32_t hash, void* value){
+    size_t mask = table->capacity - 1;
+    size_t i = hash & mask;
+    while(table->slots[i].value != NULL && table->slots[i].value != TOMBSTONE){
+        i = (i + 1) & mask;
+    }
+    bool wasTombstone = table->slots[i].value == TOMBSTONE;
+    __atomic_store_n(&(table->slots[i].hash), hash, __ATOMIC_RELAXED);
+    __atomic_store_n(&(table->slots[i].value), value, __ATOMIC_RELEASE);
+    return wasTombstone;
+}
+
+//Moves all the values to a new table, dropping the tombstones. The new table is only published once it's complete,
+//and the old one is retired, since lookups might still be reading it
+static bool rehash(HashIndex* index, size_t newCapacity){
+    HashIndexTable* newTable = allocateTable(newCapacity);
+    if(newTable == NULL){
+        return false;
+    }
+    HashIndexTable* oldTable = index->table;
+    for(size_t i = 0; i < oldTable->capacity; i++){
+        HashIndexSlot* slot = &(oldTable->slots[i]);
+        if(slot->value != NULL && slot->value != TOMBSTONE){
+            placeValue(newTable, slot->hash, slot->value);
+        }
+    }
+    __atomic_store_n(&(index->table), newTable, __ATOMIC_RELEASE);
+    index->tombstones = 0;
+    epochRetire(index->epoch, oldTable, free);
+    return true;
+}
+
+
+
+void hashIndexFree(HashIndex* index){
+    free(index->table);
+    index->table = NULL;
+    index->count = 0;
+    index->tombstones = 0;
+}
+
+//Can be called concurrently with insertions and removals
+void* hashIndexGet(HashIndex* index, const char* key){
+    void* value = NULL;
+    HashIndexSlot* slot = findSlot(__atomic_load_n(&(index->table), __ATOMIC_ACQUIRE), index->getKey, key, hashString(key), &value);
+    return slot == NULL ? NULL : value;
+}
+
+//Initializes an empty index able to hold at least capacity values before having to grow.
+//epoch can be NULL if the index is never read without holding the lock that serializes its writers
+bool hashIndexInit(HashIndex* index, size_t capacity, HashIndexKeyFunction getKey, EpochDomain* epoch){
+    size_t actualCapacity = HASH_INDEX_MIN_CAPACITY;
+    while(actualCapacity < capacity * 2){
+        actualCapacity *= 2;
+    }
+    index->table = allocateTable(actualCapacity);
+    if(index->table == NULL){
+        return false;
+    }
+    index->count = 0;
+    index->tombstones = 0;
+    index->getKey = getKey;
+    index->epoch = epoch;
+    return true;
+}
+
+//Inserts a value in the index. Returns false if a value with the same key is already present, or if the index can't grow
+bool hashIndexInsert(HashIndex* index, void* value){
+    const char* key = index->getKey(value);
+    uint32_t hash = hashString(key);
+    void* existing = NULL;
+    if(findSlot(index->table, index->getKey, key, hash, &existing) != NULL){
+        return false;
+    }
+    //Keep the load factor, tombstones included, below 3/4 so that probe sequences stay short
+    if((index->count + index->tombstones + 1) * 4 > index->table->capacity * 3){
+        size_t newCapacity = index->table->capacity;
+        if((index->count + 1) * 2 > newCapacity){
+            newCapacity *= 2;
+        }
+        if(!rehash(index, newCapacity)){
+            return false;
+        }
+    }
+    if(placeValue(index->table, hash, value)){
+        index->tombstones--;
+    }
+    index->count++;
+    return true;
+}
+
+//Removes the value with the key passed from the index, returning it, or NULL if there was none
+void* hashIndexRemove(HashIndex* index, const char* key){
+    void* value = NULL;
+    HashIndexSlot* slot = findSlot(index->table, index->getKey, key, hashString(key), &value);
+    if(slot == NULL){
+        return NULL;
+    }
+    __atomic_store_n(&(slot->value), TOMBSTONE, __ATOMIC_RELEASE);
+    index->count--;
+    index->tombstones++;
+    return value;
+}
+
+//32 bit FNV-1a hash of a string
+uint32_t hashString(const char* key){
+    uint32_t hash = FNV_OFFSET_BASIS;
+    for(const unsigned char* c = (const unsigned char*)key; *c != '\0'; c++){
+        hash ^= *c;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
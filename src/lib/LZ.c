@@ -0,0 +1,361 @@
+#include <malloc.h>
+#include <string.h>
+
+#include "../include/LZ.h"
+
+
+
+//Reads 4 bytes, without alignment requirements
+static uint32_t read32(const uint8_t* pointer){
+    uint32_t out;
+    memcpy(&out, pointer, sizeof(uint32_t));
+    return out;
+}
+
+//Returns the slot of a hash table of 2^bits slots for the 4 bytes starting at a position
+static uint32_t hashSequence(uint32_t sequence, unsigned int bits){
+    return (sequence * 2654435761u) >> (32 - bits);
+}
+
+//Writes the bytes extending a length that doesn't fit in its nibble of the token
+static uint8_t* writeLength(uint8_t* out, size_t length){
+    while(length >= 255){
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = (uint8_t)length;
+    return out;
+}
+
+//Reads the bytes extending a length whose nibble of the token is 15. Returns false if the buffer ends before them
+static bool readLength(const uint8_t** in, const uint8_t* end, size_t* length){
+    uint8_t byte;
+    do{
+        if(*in >= end){
+            return false;
+        }
+        byte = *(*in)++;
+        *length += byte;
+    }while(byte == 255);
+    return true;
+}
+
+//Writes a sequence of literals, followed by a match unless matchLength is 0. Returns the end of the sequence written,
+//or NULL if it doesn't fit before the end of the output
+static uint8_t* writeSequence(uint8_t* out, uint8_t* end, const uint8_t* literals, size_t literalLength, size_t offset, size_t matchLength){
+    if((size_t)(end - out) < 1 + literalLength / 255 + 1 + literalLength + 2 + matchLength / 255 + 1){
+        return NULL;
+    }
+    uint8_t* token = out++;
+    *token = (literalLength < 15 ? literalLength : 15) << 4;
+    if(literalLength >= 15){
+        out = writeLength(out, literalLength - 15);
+    }
+    memcpy(out, literals, literalLength);
+    out += literalLength;
+    if(matchLength > 0){
+        *out++ = offset & 0xFF;
+        *out++ = offset >> 8;
+        matchLength -= LZ_MIN_MATCH;
+        *token |= matchLength < 15 ? matchLength : 15;
+        if(matchLength >= 15){
+            out = writeLength(out, matchLength - 15);
+        }
+    }
+    return out;
+}
+
+
+
+//Compresses the bytes of data, size bytes in total, that follow its first prefixSize bytes in out, which can hold capacity bytes.
+//The prefix isn't compressed, but it's indexed so that the data can refer to it. Returns the size of the compressed buffer,
+//or 0 if there's no memory left or the compressed buffer doesn't fit in capacity bytes
+static size_t compressAfterPrefix(const char* data, size_t prefixSize, size_t size, char* out, size_t capacity, int level){
+    const uint8_t* in = (const uint8_t*)data;
+    uint8_t* output = (uint8_t*)out;
+    uint8_t* outputEnd = output + capacity;
+    //The tables are sized on the data, so that small buffers don't pay for clearing tables much bigger than them
+    unsigned int hashBits = LZ_MIN_HASH_BITS;
+    while(hashBits < LZ_HASH_BITS && ((size_t)1 << hashBits) < size){
+        hashBits++;
+    }
+    //Positions plus one, so that 0 marks the empty slots
+    uint32_t* head = calloc((size_t)1 << hashBits, sizeof(uint32_t));
+    //Distance from each position in the window to the previous one with the same hash, 0 if there's none
+    uint16_t* chain = level > 1 ? malloc((size < LZ_WINDOW_SIZE ? size + 1 : LZ_WINDOW_SIZE) * sizeof(uint16_t)) : NULL;
+    if(head == NULL || (level > 1 && chain == NULL)){
+        free(head);
+        free(chain);
+        return 0;
+    }
+    unsigned int maxAttempts = level > 1 ? 1u << ((level < LZ_MAX_LEVEL ? level : LZ_MAX_LEVEL) - 1) : 1;
+
+    //Matches end LZ_LAST_LITERALS bytes before the end of the data at the latest
+    size_t matchLimit = size > LZ_LAST_LITERALS ? size - LZ_LAST_LITERALS : 0;
+    //The positions of the prefix are indexed as if they were matches
+    for(size_t i = 0; i + LZ_MIN_MATCH <= prefixSize; i++){
+        uint32_t slot = hashSequence(read32(in + i), hashBits);
+        if(chain != NULL){
+            chain[i % LZ_WINDOW_SIZE] = head[slot] != 0 && i - (head[slot] - 1) < LZ_WINDOW_SIZE ? i - (head[slot] - 1) : 0;
+        }
+        head[slot] = i + 1;
+    }
+    size_t anchor = prefixSize;
+    size_t position = prefixSize;
+    unsigned int misses = 0;
+    while(position + LZ_MIN_MATCH <= matchLimit){
+        uint32_t sequence = read32(in + position);
+        uint32_t slot = hashSequence(sequence, hashBits);
+        size_t candidate = head[slot];
+        if(chain != NULL){
+            chain[position % LZ_WINDOW_SIZE] = candidate != 0 && position - (candidate - 1) < LZ_WINDOW_SIZE ? position - (candidate - 1) : 0;
+        }
+        head[slot] = position + 1;
+
+        //Look for the longest match among the previous positions with the same hash
+        size_t bestLength = 0;
+        size_t bestOffset = 0;
+        for(unsigned int attempt = 0; attempt < maxAttempts && candidate != 0; attempt++){
+            size_t match = candidate - 1;
+            size_t offset = position - match;
+            if(offset >= LZ_WINDOW_SIZE){
+                break;
+            }
+            if(read32(in + match) == sequence){
+                size_t length = LZ_MIN_MATCH;
+                while(position + length < matchLimit && in[match + length] == in[position + length]){
+                    length++;
+                }
+                if(length > bestLength){
+                    bestLength = length;
+                    bestOffset = offset;
+                }
+            }
+            if(chain == NULL || chain[match % LZ_WINDOW_SIZE] == 0){
+                break;
+            }
+            candidate -= chain[match % LZ_WINDOW_SIZE];
+        }
+
+        if(bestLength == 0){
+            //The longer no match is found, the bigger the steps, so that data that doesn't compress is skipped quickly
+            position += 1 + (misses++ >> 6);
+            continue;
+        }
+        misses = 0;
+        output = writeSequence(output, outputEnd, in + anchor, position - anchor, bestOffset, bestLength);
+        if(output == NULL){
+            break;
+        }
+        if(chain != NULL){
+            //The positions inside the match are indexed too, so that later matches can start from them
+            for(size_t i = position + 1; i < position + bestLength && i + LZ_MIN_MATCH <= matchLimit; i++){
+                uint32_t inner = hashSequence(read32(in + i), hashBits);
+                chain[i % LZ_WINDOW_SIZE] = head[inner] != 0 && i - (head[inner] - 1) < LZ_WINDOW_SIZE ? i - (head[inner] - 1) : 0;
+                head[inner] = i + 1;
+            }
+        }
+        position += bestLength;
+        anchor = position;
+    }
+    if(output != NULL){
+        output = writeSequence(output, outputEnd, in + anchor, size - anchor, 0, 0);
+    }
+    free(head);
+    free(chain);
+    return output == NULL ? 0 : (size_t)(output - (uint8_t*)out);
+}
+
+//Decompresses a buffer in out after its first prefixSize bytes, which the matches can refer to. Returns false if the buffer is
+//corrupted or doesn't decompress to exactly fill the outSize bytes of out. Never reads or writes out of the buffers passed,
+//whatever their contents
+static bool decompressAfterPrefix(const char* data, size_t size, char* out, size_t prefixSize, size_t outSize){
+    const uint8_t* in = (const uint8_t*)data;
+    const uint8_t* inEnd = in + size;
+    uint8_t* output = (uint8_t*)out + prefixSize;
+    uint8_t* outputEnd = (uint8_t*)out + outSize;
+    while(in < inEnd){
+        uint8_t token = *in++;
+        size_t literalLength = token >> 4;
+        if(literalLength == 15 && !readLength(&in, inEnd, &literalLength)){
+            return false;
+        }
+        if(literalLength > (size_t)(inEnd - in) || literalLength > (size_t)(outputEnd - output)){
+            return false;
+        }
+        if(literalLength <= LZ_WILD_COPY_SIZE && inEnd - in >= LZ_WILD_COPY_SIZE && outputEnd - output >= LZ_WILD_COPY_SIZE){
+            //Short literals are copied with a fixed size copy, which is faster than one of the exact size. The bytes copied
+            //past the literals are overwritten by the next sequence
+            memcpy(output, in, LZ_WILD_COPY_SIZE);
+        }else{
+            memcpy(output, in, literalLength);
+        }
+        output += literalLength;
+        in += literalLength;
+        if(in == inEnd){
+            //Last sequence
+            break;
+        }
+
+        if(inEnd - in < 2){
+            return false;
+        }
+        size_t offset = in[0] | ((size_t)in[1] << 8);
+        in += 2;
+        size_t matchLength = token & 15;
+        if(matchLength == 15 && !readLength(&in, inEnd, &matchLength)){
+            return false;
+        }
+        matchLength += LZ_MIN_MATCH;
+        if(offset == 0 || offset > (size_t)(output - (uint8_t*)out) || matchLength > (size_t)(outputEnd - output)){
+            return false;
+        }
+        const uint8_t* match = output - offset;
+        if(offset >= 8 && (size_t)(outputEnd - output) >= matchLength + 8){
+            //Copied 8 bytes at a time, even if the match overlaps the bytes being written: each block only reads bytes
+            //already written. The bytes copied past the match are overwritten by the next sequence
+            for(size_t i = 0; i < matchLength; i += 8){
+                memcpy(output + i, match + i, 8);
+            }
+        }else if(offset >= matchLength){
+            memcpy(output, match, matchLength);
+        }else{
+            //Repetition of a short pattern
+            for(size_t i = 0; i < matchLength; i++){
+                output[i] = match[i];
+            }
+        }
+        output += matchLength;
+    }
+    return output == outputEnd;
+}
+
+
+
+//Returns the size of the largest compressed buffer for size bytes, reached when no match is found
+size_t lzBound(size_t size){
+    return size + size / 255 + 16;
+}
+
+//Compresses size bytes of data in out, which can hold capacity bytes. Returns the size of the compressed buffer, or 0 if there's
+//no memory left or the compressed buffer doesn't fit in capacity bytes
+size_t lzCompress(const char* data, size_t size, char* out, size_t capacity, int level){
+    return compressAfterPrefix(data, 0, size, out, capacity, level);
+}
+
+//Compresses data as lzCompress does, with a preset dictionary that its matches can refer to as if it preceded the data.
+//There's no state prepared from the dictionary, since the hash table is sized on each buffer
+size_t lzCompressWithDictionary(const char* dictionary, size_t dictionarySize, const void* prepared, const char* data, size_t size, char* out, size_t capacity, int level){
+    char* buffer = malloc(dictionarySize + size);
+    if(buffer == NULL){
+        return 0;
+    }
+    memcpy(buffer, dictionary, dictionarySize);
+    memcpy(buffer + dictionarySize, data, size);
+    size_t compressedSize = compressAfterPrefix(buffer, dictionarySize, dictionarySize + size, out, capacity, level);
+    free(buffer);
+    return compressedSize;
+}
+
+//Decompresses a buffer in out, which has to be as big as the uncompressed data. Returns false if the buffer is corrupted or
+//doesn't decompress to exactly outSize bytes. Never reads or writes out of the buffers passed, whatever their contents
+bool lzDecompress(const char* data, size_t size, char* out, size_t outSize){
+    return decompressAfterPrefix(data, size, out, 0, outSize);
+}
+
+//Decompresses a buffer as lzDecompressWithDictionary does, but in a buffer of LZ_STREAM_BUFFER_SIZE bytes instead of one as
+//big as the uncompressed data. Once the buffer is full, the bytes decompressed since the last time are passed to output,
+//and the last LZ_WINDOW_SIZE bytes, which the next matches can still refer to, are moved to its beginning. The dictionary
+//can be NULL, and only its last LZ_WINDOW_SIZE bytes are used. Returns false if there's no memory left, if the buffer is
+//corrupted or doesn't decompress to exactly outSize bytes, or if output returns false. In that case, part of the data may
+//have already been passed to output
+bool lzDecompressStream(const char* dictionary, size_t dictionarySize, const char* data, size_t size, size_t outSize, CodecOutput output, void* argument){
+    uint8_t* buffer = malloc(LZ_STREAM_BUFFER_SIZE);
+    if(buffer == NULL){
+        return false;
+    }
+    if(dictionarySize > LZ_WINDOW_SIZE){
+        dictionary += dictionarySize - LZ_WINDOW_SIZE;
+        dictionarySize = LZ_WINDOW_SIZE;
+    }
+    if(dictionarySize > 0){
+        memcpy(buffer + LZ_WINDOW_SIZE - dictionarySize, dictionary, dictionarySize);
+    }
+    const uint8_t* in = (const uint8_t*)data;
+    const uint8_t* inEnd = in + size;
+    uint8_t* bufferEnd = buffer + LZ_STREAM_BUFFER_SIZE;
+    uint8_t* out = buffer + LZ_WINDOW_SIZE;
+    uint8_t* flushed = out;
+    size_t history = dictionarySize; //Bytes before out that matches can refer to
+    size_t remaining = outSize;
+    bool decompressed = true;
+    while(decompressed && in < inEnd){
+        uint8_t token = *in++;
+        size_t literalLength = token >> 4;
+        size_t matchLength = token & 15;
+        size_t offset = 0;
+        decompressed = (literalLength != 15 || readLength(&in, inEnd, &literalLength)) && literalLength <= (size_t)(inEnd - in);
+        const uint8_t* literals = in;
+        if(decompressed){
+            in += literalLength;
+        }
+        if(decompressed && in < inEnd){
+            decompressed = inEnd - in >= 2;
+            if(decompressed){
+                offset = in[0] | ((size_t)in[1] << 8);
+                in += 2;
+                decompressed = (matchLength != 15 || readLength(&in, inEnd, &matchLength)) && offset > 0;
+                matchLength += LZ_MIN_MATCH;
+            }
+        }else{
+            //Last sequence
+            matchLength = 0;
+        }
+        decompressed = decompressed && literalLength + matchLength <= remaining && offset <= history + literalLength;
+        //Both the literals and the match are copied in pieces that fit before the end of the buffer, the match in pieces
+        //no longer than its offset as well, so that each piece only reads bytes already written
+        for(size_t copied = 0; decompressed && copied < literalLength + matchLength;){
+            if(out == bufferEnd){
+                if(!output((const char*)flushed, out - flushed, argument)){
+                    decompressed = false;
+                    break;
+                }
+                memcpy(buffer, bufferEnd - LZ_WINDOW_SIZE, LZ_WINDOW_SIZE);
+                out = buffer + LZ_WINDOW_SIZE;
+                flushed = out;
+            }
+            size_t piece = (size_t)(bufferEnd - out);
+            if(copied < literalLength){
+                piece = piece < literalLength - copied ? piece : literalLength - copied;
+                memcpy(out, literals + copied, piece);
+            }else{
+                size_t matchLeft = literalLength + matchLength - copied;
+                piece = piece < matchLeft ? piece : matchLeft;
+                piece = piece < offset ? piece : offset;
+                memcpy(out, out - offset, piece);
+            }
+            out += piece;
+            copied += piece;
+        }
+        remaining -= decompressed ? literalLength + matchLength : 0;
+        history = history + literalLength + matchLength < LZ_WINDOW_SIZE ? history + literalLength + matchLength : LZ_WINDOW_SIZE;
+    }
+    decompressed = decompressed && remaining == 0 && (out == flushed || output((const char*)flushed, out - flushed, argument));
+    free(buffer);
+    return decompressed;
+}
+
+//Decompresses a buffer compressed by lzCompressWithDictionary, which needs the same dictionary
+bool lzDecompressWithDictionary(const char* dictionary, size_t dictionarySize, const char* data, size_t size, char* out, size_t outSize){
+    char* buffer = malloc(dictionarySize + outSize);
+    if(buffer == NULL){
+        return false;
+    }
+    memcpy(buffer, dictionary, dictionarySize);
+    bool decompressed = decompressAfterPrefix(data, size, buffer, dictionarySize, dictionarySize + outSize);
+    if(decompressed){
+        memcpy(out, buffer + dictionarySize, outSize);
+    }
+    free(buffer);
+    return decompressed;
+}
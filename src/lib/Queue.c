@@ -45,3 +45,17 @@ void queuePush(Queue** queue, void* data){
 	}
 	current->next = initQueueNode(data);
 }
+
+//Removes from the queue the first element match returns true for, and returns it. Returns NULL if there's none
+void* queueRemoveIf(Queue** queue, bool (*match)(void* data, void* argument), void* argument){
+    for(Queue** current = queue; *current != NULL; current = &((*current)->next)){
+        if(match((*current)->data, argument)){
+            Queue* node = *current;
+            *current = node->next;
+            void* out = node->data;
+            free(node);
+            return out;
+        }
+    }
+    return NULL;
+}
@@ -18,11 +18,13 @@
 ClientList* clientList = NULL;
 pthread_rwlock_t clientListLock = PTHREAD_RWLOCK_INITIALIZER;
 unsigned int clientsConnected = 0;
+DiskTier* diskTier = NULL;
+EvictionSink evictionSink = ReturnToClient;
 FileCache* fileCache = NULL;
-pthread_rwlock_t fileCacheLock = PTHREAD_RWLOCK_INITIALIZER; //Needed to add and remove files
 pthread_mutex_t incomingConnectionsLock = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t incomingConnectionsCond = PTHREAD_COND_INITIALIZER;
 int logPipeDescriptors[2];
+char* spillDirectory = NULL;
 bool workersShouldTerminate = false;
 
 
@@ -50,6 +52,48 @@ static void sendErrorToAllClientsWaitingForLock(ClientList* clientList, const ch
 	}
 }
 
+//Writes a chunk of file contents to the descriptor of a FileContentsWriter, as soon as it has been decompressed
+static bool writeFileChunk(const char* chunk, size_t size, void* argument){
+	FileContentsWriter* writer = argument;
+	ssize_t bytesWritten = writen(writer->fd, (char*)chunk, size);
+	if(bytesWritten < 0){
+		return false;
+	}
+	writer->bytesWritten += bytesWritten;
+	return true;
+}
+
+//Writes the uncompressed contents of an evicted file in spillDirectory, in a file named after the path of the evicted file
+//with its slashes replaced, so that it can be recovered later. The contents have to be pinned by the caller
+static void spillFile(CachedFile* file, FileContents* contents, int workerID){
+	size_t pathLength = strlen(spillDirectory) + strlen(file->filename) + 2;
+	char* path = malloc(pathLength);
+	if(path == NULL){
+		return;
+	}
+	snprintf(path, pathLength, "%s/%s", spillDirectory, file->filename);
+	for(char* c = path + strlen(spillDirectory) + 1; *c != '\0'; c++){
+		if(*c == '/'){
+			*c = '_';
+		}
+	}
+	char actor[32];
+	if(workerID < 0){
+		snprintf(actor, sizeof(actor), "Reclaimer");
+	}else{
+		snprintf(actor, sizeof(actor), "Worker #%d", workerID);
+	}
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(fd == -1){
+		serverLog("[%s]: Couldn't spill file \"%s\" to \"%s\"\n", actor, file->filename, path);
+	}else{
+		ssize_t bytesWritten = serverWriteFileContents(contents, fd, 0);
+		close(fd);
+		serverLog("[%s]: Spilled file \"%s\" to \"%s\", %ld bytes written\n", actor, file->filename, path, bytesWritten);
+	}
+	free(path);
+}
+
 
 
 //Adds a file descriptor to a fd set, updating the int that stores the max fd in the set
@@ -69,11 +113,16 @@ void closeAllClientDescriptors(){
 	pthread_rwlock_unlock_error(&clientListLock, "Error while unlocking client list");
 }
 
+//Files are looked up without locks, see getFile
 bool fileExistsL(const char* filename){
-    pthread_rwlock_rdlock_error(&fileCacheLock, "Error while locking on file cache");
-    bool exists = fileExists(fileCache, filename);
-    pthread_rwlock_unlock_error(&fileCacheLock, "Error while unlocking on file cache");
-    return exists;
+    return fileExists(fileCache, filename);
+}
+
+int32_t getClientCodecsL(int descriptor){
+	pthread_rwlock_rdlock_error(&clientListLock, "Error while locking on client list");
+	int32_t codecs = clientListGetCodecs(clientList, descriptor);
+	pthread_rwlock_unlock_error(&clientListLock, "Error while unlocking on client list");
+	return codecs;
 }
 
 int getClientWaitingForLockL(const char* filename){
@@ -92,10 +141,7 @@ int getClientWaitingForLockL(const char* filename){
 }
 
 CachedFile* getFileL(const char* filename){
-    pthread_rwlock_rdlock_error(&fileCacheLock, "Error while locking file cache");
-    CachedFile* file = getFile(fileCache, filename);
-    pthread_rwlock_unlock_error(&fileCacheLock, "Error while unlocking file cache");
-    return file;
+    return getFile(fileCache, filename);
 }
 
 bool isFileOpenedByClientL(const char* filename, int descriptor){
@@ -184,48 +230,83 @@ void serverDisconnectClientL(int clientFd, bool lockClientList){
 	serverLog("[Master]: Client %d disconnected\n",clientFd);
 	
 	//Unlock files locked by the client
-	pthread_rwlock_wrlock_error(&fileCacheLock, "Error while locking file cache");
 	unlockAllFilesLockedByClient(fileCache, clientFd);
-	pthread_rwlock_unlock_error(&fileCacheLock, "Error while unlocking file cache");
     //close(clientFd);
 }
 
-//Utility function to evict a file from the server
-int serverEvictFile(const char* fileToExclude, const char* operation, int fdToServe, int workerID){
-	const char* evictedFileName = getFileToEvict(fileCache, fileToExclude);
-	if(evictedFileName == NULL){
-		serverLog("[Worker #%d]: %s request can't be fulfilled because of a capacity fault, no file can be evicted to fulfill it\n", workerID, operation);
-		return -1;
-	}else{
-		serverLog("[Worker #%d]: %s request can't be fulfilled because of a capacity fault, evicting file \"%s\"\n", workerID, operation, evictedFileName);
-		CachedFile* evictedFile = getFile(fileCache, evictedFileName);
-        if(evictedFile == NULL  ){
-            serverLog("[Worker #%d]: %s request can't be fulfilled because of a capacity fault, no file can be evicted to fulfill it\n", workerID, operation);
-            return -1;
-        }
-		pthread_mutex_lock_error(evictedFile->lock, "Error while locking on file");
-		char* evictedFileBuffer = NULL;
-		size_t evictedFileSize = 0;
-		readCachedFile(evictedFile, &evictedFileBuffer, &evictedFileSize);
-		fcpSend(FCP_WRITE, (int32_t)evictedFileSize, (char*)evictedFileName, fdToServe);
-		ssize_t bytesSent = writen(fdToServe, evictedFileBuffer, evictedFileSize);
-		free(evictedFileBuffer);
-		serverLog("[Worker #%d]: Sent file to client %d, %ld bytes transferred\n", workerID, fdToServe, bytesSent);
-		pthread_mutex_unlock_error(evictedFile->lock, "Error while unlocking file");
-		serverRemoveFile(evictedFileName, workerID);
-		return 0;
+//Detaches from the cache the files that have to be evicted to make room for a request, in a single pass of the caching
+//algorithm, and closes them for every client. The victims can come from any shard, so this has to be called without holding
+//any shard lock or file lock. The victims have to be passed to serverDisposeEvictedFiles afterwards. fileToExclude is NULL
+//if any file can be evicted, operation is NULL for the evictions done by the reclaimer
+FileList* serverDetachVictims(const char* fileToExclude, size_t bytesNeeded, unsigned int filesNeeded, const char* operation, int workerID){
+	FileList* victims = detachFilesToEvict(fileCache, fileToExclude, bytesNeeded, filesNeeded);
+	if(victims == NULL){
+		return NULL;
+	}
+	pthread_rwlock_wrlock_error(&clientListLock, "Error while locking on client list");
+	for(FileList* current = victims; current != NULL; current = current->next){
+		if(operation == NULL){
+			serverLog("[Reclaimer]: Storage above the high watermark, evicting file \"%s\"\n", current->file->filename);
+		}else{
+			serverLog("[Worker #%d]: %s request can't be fulfilled because of a capacity fault, evicting file \"%s\"\n", workerID, operation, current->file->filename);
+		}
+		closeFileForEveryone(clientList, current->file->filename);
+		sendErrorToAllClientsWaitingForLock(clientList, current->file->filename, workerID);
 	}
+	pthread_rwlock_unlock_error(&clientListLock, "Error while unlocking on client list");
+	return victims;
+}
+
+//Hands the files detached by serverDetachVictims to the configured eviction sink, then retires them, since workers that
+//looked them up before they were detached might still be using them. With ReturnToClient the files are sent to the client
+//whose request caused the eviction. The victims are no longer reachable from the cache, so this is done without holding
+//any shard lock, and their contents, pinned in evictedContents when they were detached, are released as soon as the sink
+//is done with them instead of when the victims are freed
+void serverDisposeEvictedFiles(FileList* victims, int fdToServe, int workerID){
+	for(FileList* current = victims; current != NULL; current = current->next){
+		CachedFile* evictedFile = current->file;
+		FileContents* contents = evictedFile->evictedContents;
+		evictedFile->evictedContents = NULL;
+		switch(evictionSink){
+			case ReturnToClient:{
+				size_t evictedFileSize = contents == NULL ? 0 : contents->uncompressedSize;
+				fcpSend(FCP_WRITE, (int32_t)evictedFileSize, evictedFile->filename, fdToServe);
+				ssize_t bytesSent = serverWriteFileContents(contents, fdToServe, getClientCodecsL(fdToServe));
+				serverLog("[Worker #%d]: Sent file to client %d, %ld bytes transferred\n", workerID, fdToServe, bytesSent);
+				break;
+			}
+			case Spill:{
+				spillFile(evictedFile, contents, workerID);
+				break;
+			}
+			case Tier:{
+				bool written = diskTierPut(diskTier, evictedFile->filename, contents);
+				if(workerID < 0){
+					serverLog("[Reclaimer]: %s file \"%s\" to the disk tier\n", written ? "Moved" : "Couldn't move", evictedFile->filename);
+				}else{
+					serverLog("[Worker #%d]: %s file \"%s\" to the disk tier\n", workerID, written ? "Moved" : "Couldn't move", evictedFile->filename);
+				}
+				break;
+			}
+			case Discard:
+			default:{
+				break;
+			}
+		}
+		unpinFileContents(contents);
+	}
+	retireFileList(fileCache, &victims);
 }
 
 //Utility function to lock a file, or to put the client in WaitingForLock mode if the lock can't be acquired now
 bool serverLockFileL(int workerID, int fdToServe, const char* filename, CachedFile *file, bool sendAck){
     bool locked = false;
-    pthread_mutex_lock_error(file->lock, "Error while locking file");
+    pthread_mutex_lock_error(&(file->lock), "Error while locking file");
     if(file->lockedBy == -1 || file->lockedBy == fdToServe){
         locked = true;
         file->lockedBy = fdToServe;
     }
-    pthread_mutex_unlock_error(file->lock, "Error while unlocking file");
+    pthread_mutex_unlock_error(&(file->lock), "Error while unlocking file");
 
     if(locked){
         serverLog("[Worker #%d]: Client %d successfully locked the file\n", workerID, fdToServe);
@@ -253,37 +334,58 @@ void serverLog(const char* format, ...){
     va_end(args);
 }
 
-void serverRemoveFile(const char* filename, int workerID){
-	pthread_rwlock_wrlock_error(&clientListLock, "Error while locking on client list");
-	closeFileForEveryone(clientList, filename);
-	sendErrorToAllClientsWaitingForLock(clientList, filename, workerID);
-	pthread_rwlock_unlock_error(&clientListLock, "Error while unlocking on client list");
-	removeFileFromCache(fileCache, filename);
-}
-
 void serverRemoveFileL(const char* filename, int workerID){
     pthread_rwlock_wrlock_error(&clientListLock, "Error while locking on client list");
     closeFileForEveryone(clientList, filename);
     sendErrorToAllClientsWaitingForLock(clientList, filename, workerID);
     pthread_rwlock_unlock_error(&clientListLock, "Error while unlocking on client list");
-    pthread_rwlock_wrlock_error(&fileCacheLock, "Error while locking on file cache");
     removeFileFromCache(fileCache, filename);
-    pthread_rwlock_unlock_error(&fileCacheLock, "Error while unlocking on file cache");
+    if(diskTier != NULL){
+        //A copy evicted while the file was being created again would bring it back
+        diskTierRemove(diskTier, filename);
+    }
 }
 
 void serverSignalFileUnlockL(CachedFile* file, int workerID, int desc){
 	serverLog("[Worker #%d]: Passing lock to client %d\n", workerID, desc);
-	pthread_mutex_lock_error(file->lock, "Error while locking file");
+	pthread_mutex_lock_error(&(file->lock), "Error while locking file");
 	if(file->lockedBy == -1){
 		file->lockedBy = desc;
 	}
-	pthread_mutex_unlock_error(file->lock, "Error while unlocking file");
+	pthread_mutex_unlock_error(&(file->lock), "Error while unlocking file");
 	updateClientStatusL(Connected, 0, NULL, desc);
 	fcpSend(FCP_ACK, 0, NULL, desc);
 	serverLog("[Worker #%d]: Client %d successfully locked the file\n", workerID, desc);
 	w2mSend(W2M_CLIENT_SERVED, desc);
 }
 
+//Writes the uncompressed contents of a file to a descriptor, as a range covering all of them. Large compressed segments are
+//decompressed a window at a time, each written as soon as it's decompressed, see streamFileSegment. If codecs isn't 0, the
+//descriptor is a client that negotiated compressed transfers, and the contents are written as frames instead, one for each
+//segment, so that the segments compressed with a codec in codecs are sent without decompressing them. The contents have to be
+//pinned by the caller, and can be NULL for files that have never been written. Returns the number of bytes written,
+//or -1 if there's an error
+ssize_t serverWriteFileContents(FileContents* contents, int fd, int32_t codecs){
+	FileContentsWriter writer = {fd, 0};
+	bool written = true;
+	if(codecs == 0){
+		written = streamFileRange(contents, 0, contents == NULL ? 0 : contents->uncompressedSize, writeFileChunk, &writer);
+	}else{
+		written = streamFileFrames(contents, codecs, writeFileChunk, &writer);
+	}
+	if(!written){
+		perror("Error while writing file contents");
+		return -1;
+	}
+	return writer.bytesWritten;
+}
+
+void setClientCodecsL(int32_t codecs, int fdToServe){
+	pthread_rwlock_wrlock_error(&clientListLock, "Error while locking client list");
+	clientListSetCodecs(clientList, fdToServe, codecs);
+	pthread_rwlock_unlock_error(&clientListLock, "Error while unlocking client list");
+}
+
 void terminateServer(short *running){
 	*running = false;
 	workersShouldTerminate = true;
@@ -295,13 +397,23 @@ void terminateServer(short *running){
 	pthread_mutex_unlock_error(&incomingConnectionsLock, "Error while unlocking incoming connections");
 }
 
+//Unlocks all the files locked by a client with a single pass on the lists of files of the shards, giving back the storage
+//reserved for data the client didn't send
 void unlockAllFilesLockedByClient(FileCache* fileCache, int clientFd){
-    CachedFile* current = getFileLockedByClient(fileCache, clientFd);
-    while(current != NULL){
-        pthread_mutex_lock_error(current->lock, "Error while locking file");
-        current->lockedBy = -1;
-        pthread_mutex_unlock_error(current->lock, "Error while unlocking file");
-        current = getFileLockedByClient(fileCache, clientFd);
+    for(unsigned int i = 0; i < fileCache->shardCount; i++){
+        FileCacheShard* shard = &(fileCache->shards[i]);
+        pthread_rwlock_rdlock_error(&(shard->lock), "Error while locking shard");
+        FileList* current = shard->files;
+        while(current != NULL){
+            pthread_mutex_lock_error(&(current->file->lock), "Error while locking file");
+            if(current->file->lockedBy == clientFd){
+                releaseFileCapacity(fileCache, current->file);
+                current->file->lockedBy = -1;
+            }
+            pthread_mutex_unlock_error(&(current->file->lock), "Error while unlocking file");
+            current = current->next;
+        }
+        pthread_rwlock_unlock_error(&(shard->lock), "Error while unlocking shard");
     }
 }
 
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../include/Slab.h"
+
+
+
+//Allocates a new chunk and adds all its records to the free list. Has to be called with the lock of the slab held
+static bool growSlab(Slab* slab){
+    void* memory = NULL;
+    if(posix_memalign(&memory, SLAB_CACHE_LINE_SIZE, SLAB_CACHE_LINE_SIZE + slab->recordSize * SLAB_RECORDS_PER_CHUNK)){
+        return false;
+    }
+    SlabChunk* chunk = memory;
+    chunk->next = slab->chunks;
+    slab->chunks = chunk;
+    char* records = (char*)memory + SLAB_CACHE_LINE_SIZE;
+    //Linked in reverse, so that records are handed out in address order
+    for(size_t i = SLAB_RECORDS_PER_CHUNK; i > 0; i--){
+        void* record = records + (i - 1) * slab->recordSize;
+        *(void**)record = slab->freeRecords;
+        slab->freeRecords = record;
+    }
+    return true;
+}
+
+
+
+//Returns an uninitialized record, or NULL if there's no memory left
+void* slabAllocate(Slab* slab){
+    pthread_mutex_lock(&(slab->lock));
+    if(slab->freeRecords == NULL && !growSlab(slab)){
+        pthread_mutex_unlock(&(slab->lock));
+        return NULL;
+    }
+    void* record = slab->freeRecords;
+    slab->freeRecords = *(void**)record;
+    slab->recordsInUse++;
+    pthread_mutex_unlock(&(slab->lock));
+    return record;
+}
+
+//Frees all the chunks of the slab, together with the records still in use
+void slabFree(Slab* slab){
+    while(slab->chunks != NULL){
+        SlabChunk* next = slab->chunks->next;
+        free(slab->chunks);
+        slab->chunks = next;
+    }
+    slab->freeRecords = NULL;
+    slab->recordsInUse = 0;
+    pthread_mutex_destroy(&(slab->lock));
+}
+
+//Initializes an empty slab of records of at least recordSize bytes. No memory is allocated until the first record is
+bool slabInit(Slab* slab, size_t recordSize){
+    if(recordSize < sizeof(void*)){
+        recordSize = sizeof(void*);
+    }
+    slab->recordSize = (recordSize + SLAB_CACHE_LINE_SIZE - 1) / SLAB_CACHE_LINE_SIZE * SLAB_CACHE_LINE_SIZE;
+    slab->freeRecords = NULL;
+    slab->chunks = NULL;
+    slab->recordsInUse = 0;
+    if(pthread_mutex_init(&(slab->lock), NULL)){
+        perror("Error while initializing slab lock");
+        return false;
+    }
+    return true;
+}
+
+//Gives a record back to the slab it was allocated from, so that it can be reused
+void slabRelease(Slab* slab, void* record){
+    pthread_mutex_lock(&(slab->lock));
+    *(void**)record = slab->freeRecords;
+    slab->freeRecords = record;
+    slab->recordsInUse--;
+    pthread_mutex_unlock(&(slab->lock));
+}
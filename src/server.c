@@ -5,6 +5,7 @@
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/resource.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <unistd.h>
@@ -23,7 +24,8 @@
 #define cleanup() \
 	unlink(socketPath);\
 	free(socketPath);\
-	free(logFilePath);
+	free(logFilePath);\
+	free(spillDirectory);
 
 typedef enum{
 	NoTime,
@@ -32,12 +34,48 @@ typedef enum{
 	Formatted
 } LogTimeFormat;
 
+//File being received by a worker, whose blocks are compressed in parallel by the compression pool
+typedef struct ParallelUpload{
+	FileContents* contents; //Started by beginFileUpload
+	pthread_mutex_t lock;
+	pthread_cond_t blockStored;
+	unsigned int blocksPending; //Queued or being compressed
+	bool failed; //Set if a block couldn't be stored
+} ParallelUpload;
+
+//Block of a ParallelUpload queued for the compression pool
+typedef struct UploadBlock{
+	ParallelUpload* upload;
+	unsigned int index;
+	char* data; //Allocated by allocateFileData, owned by the cache once the block is compressed
+	size_t size;
+} UploadBlock;
+
 static unsigned int clientsConnectedMax = 0;
 static Queue* incomingConnectionsQueue = NULL;
 static char* logFilePath = NULL;
 static short logMode = O_APPEND;
 static LogTimeFormat logTimeFormat = Timestamp;
 static unsigned int* requestsServed;
+static unsigned long highWatermarkSize = 0;
+static unsigned int highWatermarkFiles = 0;
+static unsigned long lowWatermarkSize = 0;
+static unsigned int lowWatermarkFiles = 0;
+static bool reclaimerEnabled = false;
+static bool reclaimerShouldTerminate = false;
+static pthread_mutex_t reclaimerLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reclaimerCond = PTHREAD_COND_INITIALIZER;
+static Queue* filesToCompress = NULL;
+static Queue* blocksToCompress = NULL; //Blocks of uploads, compressed before the files since the workers receiving them wait for the blocks being compressed
+static unsigned int maxPendingBlocks = 2; //Blocks of an upload that can be queued or being compressed at once
+static bool compressorsShouldTerminate = false;
+static pthread_mutex_t compressorsLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t compressorsCond = PTHREAD_COND_INITIALIZER;
+static unsigned int firstCompressorParticipant = 0; //Epoch participant ID of the first compressor thread, the ones before are the workers
+static long tieringInterval = 0; //Seconds between tiering passes, 0 if tiering is disabled
+static bool tieringShouldTerminate = false;
+static pthread_mutex_t tieringLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tieringCond = PTHREAD_COND_INITIALIZER;
 
 
 
@@ -81,6 +119,313 @@ static void* signalHandlerThread(void* arg){
 }
 
 
+//Returns true if the number of files or the storage used is above the high watermark
+static bool isAboveHighWatermark(){
+    return __atomic_load_n(&(fileCache->current.size), __ATOMIC_RELAXED) > highWatermarkSize || __atomic_load_n(&(fileCache->current.fileNumber), __ATOMIC_RELAXED) > highWatermarkFiles;
+}
+
+//Wakes the reclaimer up if the high watermark has been crossed
+static void wakeReclaimerIfNeeded(){
+    if(!reclaimerEnabled){
+        return;
+    }
+    pthread_mutex_lock_error(&reclaimerLock, "Error while locking reclaimer");
+    if(isAboveHighWatermark()){
+        pthread_cond_signal_error(&reclaimerCond, "Error while waking reclaimer up");
+    }
+    pthread_mutex_unlock_error(&reclaimerLock, "Error while unlocking reclaimer");
+}
+
+
+//Reclaimer thread: whenever the high watermark is crossed, evicts files until the low watermark is reached,
+//so that requests rarely have to evict files themselves
+static void* reclaimerThread(void* arg){
+    serverLog("[Reclaimer]: Reclaimer thread started\n");
+    pthread_mutex_lock_error(&reclaimerLock, "Error while locking reclaimer");
+    while(!reclaimerShouldTerminate){
+        if(!isAboveHighWatermark()){
+            pthread_cond_wait_error(&reclaimerCond, &reclaimerLock, "Error while waiting for the high watermark to be crossed");
+            continue;
+        }
+        pthread_mutex_unlock_error(&reclaimerLock, "Error while unlocking reclaimer");
+
+        //Only the dimensions above the high watermark are brought down to the low one
+        size_t bytesNeeded = __atomic_load_n(&(fileCache->current.size), __ATOMIC_RELAXED) > highWatermarkSize ? fileCache->max.size - lowWatermarkSize : 0;
+        unsigned int filesNeeded = __atomic_load_n(&(fileCache->current.fileNumber), __ATOMIC_RELAXED) > highWatermarkFiles ? fileCache->max.fileNumber - lowWatermarkFiles : 0;
+        FileList* victims = serverDetachVictims(NULL, bytesNeeded, filesNeeded, NULL, -1);
+        bool evicted = victims != NULL;
+        serverDisposeEvictedFiles(victims, -1, -1);
+
+        pthread_mutex_lock_error(&reclaimerLock, "Error while locking reclaimer");
+        if(!evicted && !reclaimerShouldTerminate){
+            //All the files are locked, wait for the next change before trying again
+            pthread_cond_wait_error(&reclaimerCond, &reclaimerLock, "Error while waiting for the high watermark to be crossed");
+        }
+    }
+    pthread_mutex_unlock_error(&reclaimerLock, "Error while unlocking reclaimer");
+    return 0;
+}
+
+
+//Queues a file for the compression pool
+static void requestCompression(const char* filename){
+    char* filenameCopy = strdup(filename);
+    if(filenameCopy == NULL){
+        perror("Error while requesting compression");
+        return;
+    }
+    pthread_mutex_lock_error(&compressorsLock, "Error while locking compressors");
+    queuePush(&filesToCompress, filenameCopy);
+    pthread_cond_signal_error(&compressorsCond, "Error while waking compressor up");
+    pthread_mutex_unlock_error(&compressorsLock, "Error while unlocking compressors");
+}
+
+//Accounts for a block of an upload that has been stored, waking up the worker waiting for the upload, and frees it
+static void endUploadBlock(UploadBlock* block, bool stored){
+    ParallelUpload* upload = block->upload;
+    free(block);
+    pthread_mutex_lock_error(&(upload->lock), "Error while locking upload");
+    upload->failed = upload->failed || !stored;
+    upload->blocksPending--;
+    pthread_cond_broadcast_error(&(upload->blockStored), "Error while signaling stored block");
+    pthread_mutex_unlock_error(&(upload->lock), "Error while unlocking upload");
+}
+
+//Compresses a block of an upload and stores it in its slot
+static void compressUploadBlock(UploadBlock* block){
+    endUploadBlock(block, uploadFileChunk(fileCache, block->upload->contents, block->index, block->data, block->size));
+}
+
+//Returns whether a queued block belongs to an upload, for queueRemoveIf
+static bool isBlockOfUpload(void* block, void* upload){
+    return ((UploadBlock*)block)->upload == upload;
+}
+
+//Reads size bytes of a file from a descriptor in blocks of FILE_UPLOAD_CHUNK_SIZE bytes, which are compressed in parallel by
+//the compression pool while the next ones are received, as in pigz. The worker never compresses nor waits for the pool, since
+//the client is only answered once the file has been received: when maxPendingBlocks blocks are already queued or being
+//compressed, the next block is stored as it is, and so are the blocks still queued when the last one has been received. Those
+//are left to compressFile, which compresses them after the client has been answered. Only the blocks being compressed are
+//waited for. Returns the number of bytes read, which is less than size if the client disconnects or if there's an error
+static size_t receiveFileUpload(FileContents* contents, int fd, size_t size){
+    ParallelUpload upload = {contents, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, false};
+    size_t bytesRead = 0;
+    for(unsigned int index = 0; bytesRead < size; index++){
+        size_t blockSize = size - bytesRead < FILE_UPLOAD_CHUNK_SIZE ? size - bytesRead : FILE_UPLOAD_CHUNK_SIZE;
+        UploadBlock* block = malloc(sizeof(UploadBlock));
+        char* data = allocateFileData(fileCache, blockSize);
+        if(block == NULL || data == NULL){
+            perror("Error while receiving file");
+            free(block);
+            if(data != NULL){
+                releaseFileData(fileCache, data, blockSize);
+            }
+            break;
+        }
+        if(readn(fd, data, blockSize) != blockSize){
+            free(block);
+            releaseFileData(fileCache, data, blockSize);
+            break;
+        }
+        bytesRead += blockSize;
+        block->upload = &upload;
+        block->index = index;
+        block->data = data;
+        block->size = blockSize;
+        pthread_mutex_lock_error(&(upload.lock), "Error while locking upload");
+        bool queued = upload.blocksPending < maxPendingBlocks;
+        upload.blocksPending++;
+        pthread_mutex_unlock_error(&(upload.lock), "Error while unlocking upload");
+        if(queued){
+            pthread_mutex_lock_error(&compressorsLock, "Error while locking compressors");
+            queuePush(&blocksToCompress, block);
+            pthread_cond_signal_error(&compressorsCond, "Error while waking compressor up");
+            pthread_mutex_unlock_error(&compressorsLock, "Error while unlocking compressors");
+        }else{
+            endUploadBlock(block, uploadFileFrame(fileCache, contents, index, data, blockSize, blockSize, Uncompressed));
+        }
+    }
+    while(true){
+        pthread_mutex_lock_error(&compressorsLock, "Error while locking compressors");
+        UploadBlock* block = queueRemoveIf(&blocksToCompress, isBlockOfUpload, &upload);
+        pthread_mutex_unlock_error(&compressorsLock, "Error while unlocking compressors");
+        if(block == NULL){
+            break;
+        }
+        endUploadBlock(block, uploadFileFrame(fileCache, contents, block->index, block->data, block->size, block->size, Uncompressed));
+    }
+    //The blocks reference the upload, which is on the stack of this function
+    pthread_mutex_lock_error(&(upload.lock), "Error while locking upload");
+    while(upload.blocksPending > 0){
+        pthread_cond_wait_error(&(upload.blockStored), &(upload.lock), "Error while waiting for stored block");
+    }
+    pthread_mutex_unlock_error(&(upload.lock), "Error while unlocking upload");
+    pthread_mutex_destroy(&(upload.lock));
+    pthread_cond_destroy(&(upload.blockStored));
+    return upload.failed ? 0 : bytesRead;
+}
+
+//Reads size bytes of a file from a client that negotiated compressed transfers, as frames of FCP_UPLOAD_FRAME_SIZE uncompressed
+//bytes each but the last, which are stored in the blocks of the upload as they are, see uploadFileFrame. The frames have to be
+//compressed with the codec the client has been told to use, or not compressed at all. Returns the number of uncompressed bytes
+//read, which is less than size if the client disconnects, if it sends an invalid frame or if there's an error
+static size_t receiveFileFrames(FileContents* contents, int fd, size_t size){
+    const Codec* codec = getCodec(fileCache->compressionAlgorithm);
+    size_t bytesRead = 0;
+    for(unsigned int index = 0; bytesRead < size; index++){
+        size_t blockSize = size - bytesRead < FCP_UPLOAD_FRAME_SIZE ? size - bytesRead : FCP_UPLOAD_FRAME_SIZE;
+        FCPFrameHeader header;
+        if(readn(fd, (char*)&header, sizeof(FCPFrameHeader)) != sizeof(FCPFrameHeader)){
+            break;
+        }
+        bool valid = header.uncompressedSize == blockSize;
+        if(header.compression == Uncompressed){
+            valid = valid && header.size == blockSize;
+        }else{
+            valid = valid && header.compression == fileCache->compressionAlgorithm && header.size > 0 && header.size <= codec->bound(blockSize);
+        }
+        char* data = valid ? allocateFileData(fileCache, header.size) : NULL;
+        if(data == NULL){
+            break;
+        }
+        if(readn(fd, data, header.size) != header.size){
+            releaseFileData(fileCache, data, header.size);
+            break;
+        }
+        if(!uploadFileFrame(fileCache, contents, index, data, header.size, header.uncompressedSize, header.compression)){
+            break;
+        }
+        if(header.compression != Uncompressed){
+            __atomic_add_fetch(&(fileCache->compressionStats.receivedCompressed), 1, __ATOMIC_RELAXED);
+        }
+        bytesRead += blockSize;
+    }
+    return bytesRead;
+}
+
+//Compressor thread, part of the compression pool: compresses the blocks of the files being received, the data written to the
+//files and merges the small segments left by appends, so that requests never have to wait for it. Looks the files up without
+//locks like the workers do, so it takes part in the epoch of the cache
+static void* compressorThread(void* arg){
+    unsigned int compressorID = (unsigned int)(long)arg;
+    unsigned int participant = firstCompressorParticipant + compressorID;
+    serverLog("[Compressor #%u]: Compressor thread started\n", compressorID);
+    pthread_mutex_lock_error(&compressorsLock, "Error while locking compressors");
+    while(!compressorsShouldTerminate){
+        if(!queueIsEmpty(blocksToCompress)){
+            UploadBlock* block = queuePop(&blocksToCompress);
+            pthread_mutex_unlock_error(&compressorsLock, "Error while unlocking compressors");
+            compressUploadBlock(block);
+            pthread_mutex_lock_error(&compressorsLock, "Error while locking compressors");
+            continue;
+        }
+        if(queueIsEmpty(filesToCompress)){
+            pthread_cond_wait_error(&compressorsCond, &compressorsLock, "Error while waiting for files to compress");
+            continue;
+        }
+        char* filename = queuePop(&filesToCompress);
+        pthread_mutex_unlock_error(&compressorsLock, "Error while unlocking compressors");
+
+        epochEnter(fileCache->epoch, participant);
+        CachedFile* file = getFile(fileCache, filename);
+        //Compacting first, since merged segments are compressed as a whole
+        if(file != NULL && compactFile(fileCache, file)){
+            serverLog("[Compressor #%u]: Compacted file \"%s\"\n", compressorID, filename);
+        }
+        if(file != NULL && compressFile(fileCache, file)){
+            serverLog("[Compressor #%u]: Compressed file \"%s\"\n", compressorID, filename);
+        }
+        if(file != NULL && decompressFile(fileCache, file)){
+            serverLog("[Compressor #%u]: Decompressed hot file \"%s\"\n", compressorID, filename);
+        }
+        epochExit(fileCache->epoch, participant);
+        free(filename);
+
+        pthread_mutex_lock_error(&compressorsLock, "Error while locking compressors");
+    }
+    pthread_mutex_unlock_error(&compressorsLock, "Error while unlocking compressors");
+    return 0;
+}
+
+
+//Tiering thread: every tieringInterval seconds, updates the temperature of the files, and has the compression pool decompress
+//the files that got hot and compress again the ones that got cold
+static void* tieringThread(void* arg){
+    serverLog("[Tiering]: Tiering thread started\n");
+    unsigned int hotFiles = 0;
+    pthread_mutex_lock_error(&tieringLock, "Error while locking tiering");
+    while(!tieringShouldTerminate){
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        struct timespec deadline = addTimes(now, doubleToTimespec(tieringInterval));
+        int waitResult = 0;
+        while(!tieringShouldTerminate && waitResult != ETIMEDOUT){
+            waitResult = pthread_cond_timedwait(&tieringCond, &tieringLock, &deadline);
+        }
+        if(tieringShouldTerminate){
+            break;
+        }
+        pthread_mutex_unlock_error(&tieringLock, "Error while unlocking tiering");
+
+        unsigned int newHotFiles = updateFileTemperatures(fileCache, requestCompression);
+        if(newHotFiles != hotFiles){
+            serverLog("[Tiering]: Hot files: %u\n", newHotFiles);
+            hotFiles = newHotFiles;
+        }
+
+        pthread_mutex_lock_error(&tieringLock, "Error while locking tiering");
+    }
+    pthread_mutex_unlock_error(&tieringLock, "Error while unlocking tiering");
+    return 0;
+}
+
+
+//Restores a file evicted to the disk tier when it's opened again, evicting other files to make room for it like the creation
+//of a file would. The file is read back from the tier first, so that files are only evicted once the size it takes is known
+//and the file is known to be readable. The files evicted to make room are only moved to the tier once the file has left it,
+//so that they can't push it out. If there's no room for it, the file goes back to the tier. Returns whether the file is in the
+//cache afterwards, which is also the case if another request restored it first. error is set to EMFILE if the file is in the
+//tier but there's no room for it
+static bool promoteFile(const char* filename, int fdToServe, int workerID, int* error){
+    size_t size = 0;
+    FileContents* contents = diskTierTake(diskTier, fileCache, filename, &size);
+    if(contents == NULL){
+        return fileExistsL(filename);
+    }
+    FileList* victims = serverDetachVictims(NULL, size, 1, "Open", workerID);
+    CachedFile* file = NULL;
+    if(!canFitNewFile(fileCache) || !canFitNewData(fileCache, filename, size, true)){
+        serverLog("[Worker #%d]: File \"%s\" can't be restored from the disk tier because of a capacity fault, no file can be evicted to make room for it\n", workerID, filename);
+        *error = EMFILE;
+    }else{
+        file = restoreFile(fileCache, filename, contents);
+    }
+    if(file != NULL){
+        diskTierEndTake(diskTier, filename, NULL);
+        pthread_mutex_lock_error(&(file->lock), "Error while locking file");
+        bool compressionNeeded = fileNeedsCompression(file);
+        size_t storedSize = getFileSize(file);
+        size_t uncompressedSize = getUncompressedSize(file);
+        pthread_mutex_unlock_error(&(file->lock), "Error while unlocking file");
+        serverLog("[Worker #%d]: File \"%s\" restored from the disk tier, size: %lu bytes, %lu bytes uncompressed\n", workerID, filename, storedSize, uncompressedSize);
+        if(compressionNeeded){
+            requestCompression(filename);
+        }
+    }else{
+        if(!diskTierEndTake(diskTier, filename, contents)){
+            serverLog("[Worker #%d]: File \"%s\" couldn't be moved back to the disk tier\n", workerID, filename);
+        }
+        unpinFileContents(contents);
+    }
+    //The victims can be sent to the client, the restored file is only looked up again by name
+    epochExit(fileCache->epoch, workerID);
+    serverDisposeEvictedFiles(victims, fdToServe, workerID);
+    epochEnter(fileCache->epoch, workerID);
+    wakeReclaimerIfNeeded();
+    return file != NULL || fileExistsL(filename);
+}
+
+
 //Worker thread
 //TODO: Code cleanup and DRY
 static void* workerThread(void* arg){
@@ -102,7 +447,10 @@ static void* workerThread(void* arg){
             break;
         }
 
-        //Serve connection
+        //Serve connection. The worker enters the epoch of the cache once the request has been read, and the files looked up
+        //from then on stay valid until it leaves it, even if another worker removes or evicts them in the meantime. The epoch is
+        //left around the sends and receives that can block on the client, so that a slow client doesn't hold back the
+        //reclamation of the files removed meanwhile, and the files are looked up again afterwards
 #ifdef DEBUG
         serverLog("[Worker #%d]: Serving client on descriptor %d\n", workerID, fdToServe);
 #endif
@@ -113,6 +461,7 @@ static void* workerThread(void* arg){
             case Connected:{
                 char fcpBuffer[FCP_MESSAGE_LENGTH];
                 ssize_t fcpBytesRead = readn(fdToServe, fcpBuffer, FCP_MESSAGE_LENGTH);
+                epochEnter(fileCache->epoch, workerID);
 
                 if(fcpBytesRead == 0){
                     //Client disconnected
@@ -137,12 +486,12 @@ static void* workerThread(void* arg){
                                 bool isOpen = isFileOpenedByClientL(fcpMessage->filename, fdToServe);
 
                                 if(isOpen){
-                                    pthread_mutex_lock_error(file->lock, "Error while locking file");
+                                    pthread_mutex_lock_error(&(file->lock), "Error while locking file");
                                     if(file->lockedBy != fdToServe){
                                         //File is not locked by this client
                                         error = EPERM;
                                     }
-                                    pthread_mutex_unlock_error(file->lock, "Error while unlocking file");
+                                    pthread_mutex_unlock_error(&(file->lock), "Error while unlocking file");
                                 }else{
                                     //File is not opened by this client
                                     error = EBADF;
@@ -155,21 +504,35 @@ static void* workerThread(void* arg){
                             if(error == 0){
                                 //Client can write to file, check for capacity faults
                                 bool capacityError = false;
-                                pthread_rwlock_wrlock_error(&fileCacheLock, "Error while locking file cache");
-                                pthread_mutex_lock_error(file->lock, "Error while locking on file");
-                                while(!canFitNewData(fileCache, fcpMessage->filename, fcpMessage->control, append)){
-                                	if(serverEvictFile(fcpMessage->filename, append ? "Append" : "Write", fdToServe, workerID)){
-                                        //No file can be evicted from the server
+                                FileList* victims = NULL;
+                                //The storage the data needs is reserved until it's stored, so that writes to files in other shards can't
+                                //fill it in the meantime. A write replaces the current contents of the file, so it only needs the difference
+                                size_t dataSize = (size_t)fcpMessage->control;
+                                pthread_mutex_lock_error(&(file->lock), "Error while locking on file");
+                                size_t storedSize = getFileSize(file);
+                                size_t bytesNeeded = append ? dataSize : (dataSize > storedSize ? dataSize - storedSize : 0);
+                                bool reserved = reserveFileCapacity(fileCache, file, bytesNeeded);
+                                pthread_mutex_unlock_error(&(file->lock), "Error while unlocking on file");
+                                if(!reserved){
+                                    //Evict all the files needed at once.
+                                    //The file is locked by the client, so it can't be removed or evicted in the meantime
+                                    victims = serverDetachVictims(fcpMessage->filename, bytesNeeded, 0, append ? "Append" : "Write", workerID);
+                                    pthread_mutex_lock_error(&(file->lock), "Error while locking on file");
+                                    reserved = reserveFileCapacity(fileCache, file, bytesNeeded);
+                                    pthread_mutex_unlock_error(&(file->lock), "Error while unlocking on file");
+                                    if(!reserved){
+                                        //No more files can be evicted from the server
+                                        serverLog("[Worker #%d]: %s request can't be fulfilled because of a capacity fault, no file can be evicted to fulfill it\n", workerID, append ? "Append" : "Write");
                                 		capacityError = true;
-                                        break;
-                                	}
+                                    }
                                 }
-                                pthread_mutex_unlock_error(file->lock, "Error while unlocking on file");
-                                if(capacityError && getFileSize(file) == 0){
+                                if(capacityError && storedSize == 0){
                                     //If no file can be evicted and the file is empty, delete it
-                                    serverRemoveFile(file->filename, fdToServe);
+                                    serverRemoveFileL(file->filename, workerID);
                                 }
-                                pthread_rwlock_unlock_error(&fileCacheLock, "Error while unlocking file cache");
+                                epochExit(fileCache->epoch, workerID);
+                                serverDisposeEvictedFiles(victims, fdToServe, workerID);
+                                epochEnter(fileCache->epoch, workerID);
 
                                 if(capacityError){
                                     fcpSend(FCP_ERROR, EFBIG, NULL, fdToServe);
@@ -198,29 +561,49 @@ static void* workerThread(void* arg){
                                 break;
                             }
 
+                            //Every open counts as a request for the file, whether it's cached or not, for the admission filter
+                            recordFileAccess(fileCache, fcpMessage->filename);
+
                             int error = 0;
+                            bool createIsSet = FCP_OPEN_FLAG_ISSET(fcpMessage->control, O_CREATE);
                             bool exists = fileExistsL(fcpMessage->filename);
+                            if(!exists && diskTier != NULL){
+                                //A file evicted to the disk tier still exists. It's only brought back to the cache to be opened,
+                                //since creating it fails anyway
+                                size_t tierSize = 0;
+                                exists = createIsSet ? diskTierContains(diskTier, fcpMessage->filename, &tierSize) : promoteFile(fcpMessage->filename, fdToServe, workerID, &error);
+                            }
 
-                            bool createIsSet = FCP_OPEN_FLAG_ISSET(fcpMessage->control, O_CREATE);
-                            if(exists && createIsSet){
+                            if(error == 0 && exists && createIsSet){
                                 error = EEXIST;
-                            }else if(!exists && !createIsSet){
+                            }else if(error == 0 && !exists && !createIsSet){
                                 error = ENOENT;
                             }
 
-                            if(error){
+                            if(error == EMFILE){
+                                //The file is in the disk tier, but there's no room for it in the cache
+                                fcpSend(FCP_ERROR, error, NULL, fdToServe);
+                            }else if(error){
                                 //Either the client passed the flag O_CREATE and the file existed, or it didn't pass it and the file didn't exist
                                 serverLog("[Worker #%d]: Client %d tried to %s\n", workerID, fdToServe, error == EEXIST ? "create a file that already exists" : "open a file that doesn't exist");
                                 fcpSend(FCP_ERROR, error, NULL, fdToServe);
                             }else{
                             	bool capacityError = false;
                                 CachedFile* file = NULL;
-                                pthread_rwlock_wrlock_error(&fileCacheLock, "Error while locking on file cache");
+                                FileList* victims = NULL;
                                 if(createIsSet){
                                 	if(!canFitNewFile(fileCache)){
-                                	    if(serverEvictFile(" ", "Open", fdToServe, workerID)){
-                                            //No file can be evicted to make space for the new file
+                                	    if(!admitFile(fileCache, fcpMessage->filename)){
+                                            //The new file is expected to be requested less often than the one it would replace
+                                            serverLog("[Worker #%d]: Open request refused by the admission filter\n", workerID);
                                 	    	capacityError = true;
+                                	    }else{
+                                	        victims = serverDetachVictims(NULL, 0, 1, "Open", workerID);
+                                	        if(!canFitNewFile(fileCache)){
+                                                //No file can be evicted to make space for the new file
+                                                serverLog("[Worker #%d]: Open request can't be fulfilled because of a capacity fault, no file can be evicted to fulfill it\n", workerID);
+                                	    	    capacityError = true;
+                                	        }
                                 	    }
                                 	}
                                 	if(!capacityError){
@@ -237,16 +620,23 @@ static void* workerThread(void* arg){
                                     file = getFile(fileCache, fn);
                                     free(fn);
                                 }
-                                pthread_rwlock_unlock_error(&fileCacheLock, "Error while unlocking on file cache");
+                                if(victims != NULL){
+                                    //The victims can be sent to the client, the file is looked up again afterwards
+                                    epochExit(fileCache->epoch, workerID);
+                                    serverDisposeEvictedFiles(victims, fdToServe, workerID);
+                                    epochEnter(fileCache->epoch, workerID);
+                                    file = file == NULL ? NULL : getFileL(fcpMessage->filename);
+                                }
+                                wakeReclaimerIfNeeded();
 								
                                 if(capacityError || file == NULL){
                                     //There is no space for the file
                                 	fcpSend(FCP_ERROR, EMFILE, NULL, fdToServe);
                                 }else{
                                     //Everything went well
-                                    pthread_rwlock_wrlock_error(&fileCacheLock, "Error while locking on file cache");
+                                    pthread_rwlock_wrlock_error(&clientListLock, "Error while locking on client list");
                                     setFileOpened(clientList, fdToServe, fcpMessage->filename);
-                                    pthread_rwlock_unlock_error(&fileCacheLock, "Error while unlocking on file cache");
+                                    pthread_rwlock_unlock_error(&clientListLock, "Error while unlocking on client list");
 
                                 	bool lockIsSet = FCP_OPEN_FLAG_ISSET(fcpMessage->control, O_LOCK);
                                 	if(lockIsSet){ //O_LOCK passed
@@ -277,12 +667,12 @@ static void* workerThread(void* arg){
                                 bool isOpen = isFileOpenedByClientL(fcpMessage->filename, fdToServe);
 
                                 if(isOpen){
-                                    pthread_mutex_lock_error(file->lock, "Error while locking file");
+                                    pthread_mutex_lock_error(&(file->lock), "Error while locking file");
                                     if(file->lockedBy != fdToServe){
                                         //File is not locked by this client
                                         error = EPERM;
                                     }
-                                    pthread_mutex_unlock_error(file->lock, "Error while unlocking file");
+                                    pthread_mutex_unlock_error(&(file->lock), "Error while unlocking file");
                                 }else{
                                     //File is not opened by this client
                                     error = EBADF;
@@ -294,9 +684,9 @@ static void* workerThread(void* arg){
 
                             if(error == 0){
                                 //Get file size, set client status and send file info to client
-                                pthread_mutex_lock_error(file->lock, "Error while locking file");
+                                pthread_mutex_lock_error(&(file->lock), "Error while locking file");
                                 size_t fileSize = getUncompressedSize(file);
-                                pthread_mutex_unlock_error(file->lock, "Error while unlocking file");
+                                pthread_mutex_unlock_error(&(file->lock), "Error while unlocking file");
 
                                 updateClientStatusL(ReceivingFile, (int)fileSize, fcpMessage->filename, fdToServe);
 
@@ -324,12 +714,12 @@ static void* workerThread(void* arg){
 
                                     //Unlocking file if it was locked by client
                                     int desc = -1;
-                                    pthread_mutex_lock_error(file->lock, "Error while locking file");
+                                    pthread_mutex_lock_error(&(file->lock), "Error while locking file");
                                     if(file->lockedBy == fdToServe){
                                         file -> lockedBy = -1;
                                         desc = getClientWaitingForLockL(file->filename);
                                     }
-                                    pthread_mutex_unlock_error(file->lock, "Error while unlocking file");
+                                    pthread_mutex_unlock_error(&(file->lock), "Error while unlocking file");
                                     
                                     //Pass lock to next client
                                     if(desc != -1){
@@ -408,7 +798,7 @@ static void* workerThread(void* arg){
                                 CachedFile* file = getFileL(fcpMessage->filename);
 
                                 int desc = -1;
-                                pthread_mutex_lock_error(file->lock, "Error while locking file");
+                                pthread_mutex_lock_error(&(file->lock), "Error while locking file");
                                 if(file->lockedBy == fdToServe){
                                     file -> lockedBy = -1;
                                     desc = getClientWaitingForLockL(file->filename);
@@ -416,7 +806,7 @@ static void* workerThread(void* arg){
                                     //Client tried to unlock a file that wasn't locked by it
                                     error = EPERM;
                                 }
-                                pthread_mutex_unlock_error(file->lock, "Error while unlocking file");
+                                pthread_mutex_unlock_error(&(file->lock), "Error while unlocking file");
 
                                 if(error == 0){
                                     serverLog("[Worker #%d]: Client %d successfully unlocked the file\n", workerID, fdToServe);
@@ -455,9 +845,9 @@ static void* workerThread(void* arg){
                                     fcpSend(FCP_ERROR, error, NULL, fdToServe);
                                 }else{
                                     CachedFile* file = getFileL(fcpMessage->filename);
-                                    pthread_mutex_lock_error(file->lock, "Error while locking file");
+                                    pthread_mutex_lock_error(&(file->lock), "Error while locking file");
                                     bool isFileLockedByClient = ((file->lockedBy) == fdToServe);
-                                    pthread_mutex_unlock_error(file->lock, "Error while unlocking file");
+                                    pthread_mutex_unlock_error(&(file->lock), "Error while unlocking file");
 
                                     if(isFileLockedByClient){
                                         serverRemoveFileL(fcpMessage->filename, workerID);
@@ -484,29 +874,77 @@ static void* workerThread(void* arg){
                             }else{
                                 serverLog("[Worker #%d]: Sending all files\n", workerID);
                             }
+                            //Take a snapshot of the names of the files in the cache first, so that no shard is kept locked while sending them.
+                            //Only the files that can be sent are taken, so that n of them are sent if the cache holds that many.
+                            //The names are copied, since the epoch is left while each file is sent
+                            size_t snapshotLength = 0;
+                            size_t snapshotCapacity = 0;
+                            char** snapshot = NULL;
+                            bool snapshotFailed = false;
+                            for(unsigned int i = 0; i < fileCache->shardCount && !snapshotFailed && ((n <= 0) || (snapshotLength < (size_t)n)); i++){
+                                FileCacheShard* shard = &(fileCache->shards[i]);
+                                pthread_rwlock_rdlock_error(&(shard->lock), "Error while locking shard");
+                                for(FileList* current = shard->files; current != NULL && ((n <= 0) || (snapshotLength < (size_t)n)); current = current->next){
+                                    pthread_mutex_lock_error(&(current->file->lock), "Error while locking file");
+                                    bool sendable = (current->file->lockedBy == -1 || current->file->lockedBy == fdToServe) && getFileSize(current->file) != 0;
+                                    pthread_mutex_unlock_error(&(current->file->lock), "Error while unlocking file");
+                                    if(!sendable){
+                                        continue;
+                                    }
+                                    if(snapshotLength == snapshotCapacity){
+                                        size_t newCapacity = snapshotCapacity == 0 ? 16 : snapshotCapacity * 2;
+                                        char** newSnapshot = realloc(snapshot, newCapacity * sizeof(char*));
+                                        if(newSnapshot == NULL){
+                                            perror("Error while reading files");
+                                            snapshotFailed = true;
+                                            break;
+                                        }
+                                        snapshot = newSnapshot;
+                                        snapshotCapacity = newCapacity;
+                                    }
+                                    snapshot[snapshotLength] = strndup(current->file->filename, MAX_FILENAME_SIZE - 1);
+                                    if(snapshot[snapshotLength] == NULL){
+                                        perror("Error while reading files");
+                                        snapshotFailed = true;
+                                        break;
+                                    }
+                                    snapshotLength++;
+                                }
+                                pthread_rwlock_unlock_error(&(shard->lock), "Error while unlocking shard");
+                            }
+
                             int counter = 0;
-                            pthread_rwlock_rdlock_error(&fileCacheLock, "Error while locking file cache");
-                            FileList* current = fileCache->files;
-                            while(((n <= 0) || (counter < n)) && current != NULL){
-                                pthread_mutex_lock_error(current->file->lock, "Error while locking file");
-                                //Only send files not locked by other clients and that are not empty
-                                if((current->file->lockedBy == -1 || current->file->lockedBy == fdToServe) && getFileSize(current->file) != 0) {
-                                    size_t fileSize = 0;
-                                    char *fileBuffer = NULL;
-                                    readCachedFile(current->file, &fileBuffer, &fileSize);
-
-                                    serverLog("[Worker #%d]: Sending file \"%s\" to client %d\n", workerID, current->file->filename, fdToServe);
-                                    fcpSend(FCP_WRITE, fileSize, current->file->filename, fdToServe);
-                                    ssize_t bytesTransferred = writen(fdToServe, fileBuffer, fileSize);
-                                    serverLog("[Worker #%d]: Sent file \"%s\" to client %d, bytes transferred: %ld\n", workerID, current->file->filename, fdToServe, bytesTransferred);
-
-                                    free(fileBuffer);
+                            int32_t codecs = getClientCodecsL(fdToServe);
+                            for(size_t i = 0; i < snapshotLength; i++){
+                                char* filename = snapshot[i];
+                                CachedFile* file = getFileL(filename);
+                                FileContents* contents = NULL;
+                                if(file != NULL){
+                                    pthread_mutex_lock_error(&(file->lock), "Error while locking file");
+                                    //Checked again, since the file may have been locked, emptied or removed after the snapshot
+                                    if((file->lockedBy == -1 || file->lockedBy == fdToServe) && getFileSize(file) != 0){
+                                        contents = pinFileContents(fileCache, file);
+                                    }
+                                    pthread_mutex_unlock_error(&(file->lock), "Error while unlocking file");
+                                }
+
+                                if(contents != NULL){
+                                    //The contents are sent straight from the cache, without holding any lock
+                                    epochExit(fileCache->epoch, workerID);
+                                    serverLog("[Worker #%d]: Sending file \"%s\" to client %d\n", workerID, filename, fdToServe);
+                                    fcpSend(FCP_WRITE, contents->uncompressedSize, filename, fdToServe);
+                                    ssize_t bytesTransferred = serverWriteFileContents(contents, fdToServe, codecs);
+                                    serverLog("[Worker #%d]: Sent file \"%s\" to client %d, bytes transferred: %ld\n", workerID, filename, fdToServe, bytesTransferred);
+                                    epochEnter(fileCache->epoch, workerID);
+
+                                    unpinFileContents(contents);
                                     counter++;
                                 }
-                                pthread_mutex_unlock_error(current->file->lock, "Error while unlocking file");
-                                current = current->next;
                             }
-                            pthread_rwlock_unlock_error(&fileCacheLock, "Error while unlocking file cache");
+                            for(size_t i = 0; i < snapshotLength; i++){
+                                free(snapshot[i]);
+                            }
+                            free(snapshot);
 
                             //Files sent, send ack to client and warn server
                             fcpSend(FCP_ACK, 0, NULL, fdToServe);
@@ -514,6 +952,18 @@ static void* workerThread(void* arg){
                             w2mSend(W2M_CLIENT_SERVED, fdToServe);
                             break;
                         }
+                        case FCP_HELLO:{
+                            //Client has asked for compressed transfers: record the codecs it can decode, and tell it the one to
+                            //compress the files it sends with, the one of the cache if it has it, so that they're stored as sent
+                            serverLog("[Worker #%d]: Client %d issued op: %d (FCP_HELLO), codecs: %d\n", workerID, fdToServe, fcpMessage->op, fcpMessage->control);
+                            int32_t codecs = (fcpMessage->control & (FCP_CODEC_BIT(CompressionAlgorithmCount) - 1)) | FCP_CODEC_BIT(Uncompressed);
+                            CompressionAlgorithm uploadCodec = (codecs & FCP_CODEC_BIT(fileCache->compressionAlgorithm)) ? fileCache->compressionAlgorithm : Uncompressed;
+                            setClientCodecsL(codecs, fdToServe);
+                            fcpSend(FCP_ACK, FCP_UPLOAD_CODEC(uploadCodec, uploadCodec == Uncompressed ? 0 : fileCache->compressionLevel), NULL, fdToServe);
+                            serverLog("[Worker #%d]: Client %d will send files compressed with codec \"%s\"\n", workerID, fdToServe, getCodec(uploadCodec)->name);
+                            w2mSend(W2M_CLIENT_SERVED, fdToServe);
+                            break;
+                        }
                         default:{
                             //Client has requested an invalid operation, forcibly disconnect it
                             serverLog("[Worker #%d]: Client %d has requested an invalid operation with opcode %d\n", workerID, fdToServe, fcpMessage->op);
@@ -531,8 +981,26 @@ static void* workerThread(void* arg){
                 int32_t fileSize = status.data.messageLength;
 
                 int error = 0;
-                char* buffer = malloc(fileSize);
-                size_t bytesRead = readn(fdToServe, buffer, fileSize);
+                bool stored = false;
+                char* buffer = NULL;
+                FileContents* upload = NULL;
+                size_t bytesRead = 0;
+                //Large files are compressed in blocks by the compression pool while they're received, instead of being
+                //stored whole uncompressed and compressed later. Clients that negotiated compressed transfers send the
+                //blocks already compressed instead
+                bool framed = fileSize > 0 && getClientCodecsL(fdToServe) != 0;
+                bool chunked = framed || (fileSize > FILE_UPLOAD_CHUNK_SIZE && fileCache->compressionAlgorithm != Uncompressed);
+                if(framed){
+                    upload = beginFileUpload(fileSize);
+                    bytesRead = upload == NULL ? 0 : receiveFileFrames(upload, fdToServe, fileSize);
+                }else if(chunked){
+                    upload = beginFileUpload(fileSize);
+                    bytesRead = upload == NULL ? 0 : receiveFileUpload(upload, fdToServe, fileSize);
+                }else{
+                    buffer = allocateFileData(fileCache, fileSize);
+                    bytesRead = readn(fdToServe, buffer, fileSize);
+                }
+                epochEnter(fileCache->epoch, workerID);
                 if(bytesRead != fileSize){
                     //Client sent an ill-formed packet, disconnecting it
                     serverLog("[Worker #%d]: Client %d sent a different amount of bytes than advertised (%d vs %ld), disconnecting it\n", workerID, fdToServe, status.data.messageLength, bytesRead);
@@ -546,30 +1014,36 @@ static void* workerThread(void* arg){
                     CachedFile* file = getFileL(status.data.filename);
                     if(file != NULL){
                     	size_t storedSize = 0;
-                        pthread_mutex_lock_error(file->lock, "Error while locking file");
+                    	size_t uncompressedSize = 0;
+                    	bool compressionNeeded = false;
+                        pthread_mutex_lock_error(&(file->lock), "Error while locking file");
                         if(file->lockedBy != fdToServe){
                             //File is not locked by this client
                             error = EPERM;
                         }else{
-                            //Everything is ok, file can be written
-                            if(append){
-                                char* fileBuffer;
-                                readCachedFile(file, &fileBuffer, (size_t *) &fileSize);
-                                free(file->contents);
-                                fileBuffer = realloc(fileBuffer, fileSize + bytesRead);
-                                memcpy(fileBuffer + fileSize, buffer, bytesRead);
-                                storedSize = storeFile(fileCache, file, fileBuffer, fileSize + bytesRead);
+                            //Everything is ok, file can be written. The storage reserved for the data is replaced by what it's stored in
+                            releaseFileCapacity(fileCache, file);
+                            if(chunked){
+                                storedSize = storeFileUpload(fileCache, file, upload, append);
+                            }else if(append){
+                                //The data received is stored as a new segment, the current contents are left as they are
+                                storedSize = appendToCachedFile(fileCache, file, buffer, bytesRead);
                             }else{
-                                free(file->contents);
                                 storedSize = storeFile(fileCache, file, buffer, fileSize);
                             }
+                            stored = true;
+                            //The data is compressed by the compression pool, after the client has been answered
+                            compressionNeeded = fileNeedsCompression(file) || fileNeedsCompaction(file);
+                            uncompressedSize = getUncompressedSize(file);
                         }
-                        pthread_mutex_unlock_error(file->lock, "Error while unlocking file");
-                        if(storedSize == (append ? fileSize + bytesRead : fileSize)){
-	                        serverLog("[Worker #%d]: File not compressed, size: %lu bytes\n", workerID, storedSize);
+                        pthread_mutex_unlock_error(&(file->lock), "Error while unlocking file");
+                        if(compressionNeeded){
+                            serverLog("[Worker #%d]: File stored, size: %lu bytes, %lu bytes uncompressed, queued for compression\n", workerID, storedSize, uncompressedSize);
+                            requestCompression(status.data.filename);
                         }else{
-                        	serverLog("[Worker #%d]: File has been compressed, old size: %lu bytes, new size: %lu bytes\n", workerID, (append ? fileSize + bytesRead : fileSize), storedSize);
+	                        serverLog("[Worker #%d]: File stored, size: %lu bytes, %lu bytes uncompressed\n", workerID, storedSize, uncompressedSize);
                         }
+                        wakeReclaimerIfNeeded();
                     }else{
                         //File does not exist
                         error = ENOENT;
@@ -591,16 +1065,21 @@ static void* workerThread(void* arg){
                     w2mSend(W2M_CLIENT_SERVED, fdToServe);
                 }
 
-                if(error != 0 || append){
-                    //The buffer shouldn't be deallocated if the operation was successful: to avoid copying potentially
+                if(!stored){
+                    //The buffer shouldn't be deallocated if the file has been written: to avoid copying potentially
                     // high amounts of data, the buffer is directly assigned to the file, instead of memcpying it
-                    free(buffer);
+                    if(chunked){
+                        unpinFileContents(upload);
+                    }else{
+                        releaseFileData(fileCache, buffer, status.data.messageLength);
+                    }
                 }
                 break;
             }
             case ReceivingFile:{ //Client was waiting for the server to send a file
                 char fcpBuffer[FCP_MESSAGE_LENGTH];
                 ssize_t fcpBytesRead = readn(fdToServe, fcpBuffer, FCP_MESSAGE_LENGTH);
+                epochEnter(fileCache->epoch, workerID);
 
                 if(fcpBytesRead == 0){
                     //Client disconnected
@@ -612,17 +1091,18 @@ static void* workerThread(void* arg){
                     switch(fcpMessage->op) {
                         case FCP_ACK:{
                             //Send file
-                            char* fileBuffer = NULL;
-                            size_t fileSize = 0;
-
                             CachedFile *file = getFileL(status.data.filename);
 
-                            pthread_mutex_lock_error(file->lock, "Error while locking file");
-                            readCachedFile(file, &fileBuffer, &fileSize);
-                            pthread_mutex_unlock_error(file->lock, "Error while unlocking file");
+                            pthread_mutex_lock_error(&(file->lock), "Error while locking file");
+                            FileContents* contents = pinFileContents(fileCache, file);
+                            pthread_mutex_unlock_error(&(file->lock), "Error while unlocking file");
 
-                            ssize_t bytesSent = writen(fdToServe, fileBuffer, fileSize);
-                            free(fileBuffer);
+                            //The contents are sent straight from the cache, a writer replacing them meanwhile doesn't free them
+                            int32_t codecs = getClientCodecsL(fdToServe);
+                            epochExit(fileCache->epoch, workerID);
+                            ssize_t bytesSent = serverWriteFileContents(contents, fdToServe, codecs);
+                            epochEnter(fileCache->epoch, workerID);
+                            unpinFileContents(contents);
 
                             serverLog("[Worker #%d]: Sent file to client %d, %ld bytes transferred\n", workerID, fdToServe, bytesSent);
 
@@ -645,10 +1125,12 @@ static void* workerThread(void* arg){
             default:{
                 //Invalid status
                 serverLog("[Worker #%d]: Client %d has sent a message while in an invalid status, disconnecting it\n", workerID, fdToServe);
+                epochEnter(fileCache->epoch, workerID);
                 workerDisconnectClient(workerID, fdToServe);
                 break;
             }
         }
+        epochExit(fileCache->epoch, workerID);
     }
 
     serverLog("[Worker #%d]: Terminating\n", workerID);
@@ -735,6 +1217,36 @@ static void* loggingThread(void* arg){
 }
 
 
+//Parses a size in bytes, optionally followed by a unit among K, M and G, as in "storageSize"
+static unsigned long parseSize(const char* string){
+	char* endptr = NULL;
+	unsigned long size = strtoul(string, &endptr, 10);
+	switch(*endptr){
+		case 'k':
+		case 'K':{
+			size *= 1024;
+			break;
+		}
+		case 'm':
+		case 'M':{
+			size *= 1024 * 1024;
+			break;
+		}
+		case 'g':
+		case 'G':{
+			size *= 1024 * 1024 * 1024;
+			break;
+		}
+		case 'b':
+		case 'B':
+		default:{
+			break;
+		}
+	}
+	return size;
+}
+
+
 //Master thread
 #ifdef IDE
 int serverMain(int argc, char** argv){
@@ -744,10 +1256,20 @@ int main(int argc, char** argv){
 
     CacheAlgorithm cacheAlgorithm = FIFO;
     CompressionAlgorithm compressionAlgorithm = Miniz;
+    int compressionLevel = getCodec(Miniz)->defaultLevel;
+    bool admissionFilter = false;
+    long cacheShards = FILE_CACHE_DEFAULT_SHARDS;
+    long compressionThreads = 1;
+    bool hugePages = false;
+    bool deduplication = false;
+    bool compressionDictionary = false;
+    long highWatermark = 0;
+    long lowWatermark = 0;
 	char* configFilePath = "/mnt/e/Progetti/SOL-Project/config.txt";
 	unsigned short nWorkers = 10;
 	unsigned int maxFiles = 100;
 	unsigned long storageSize = 1024 * 1024 * 1024;
+	unsigned long tierSize = 0;
 	char* socketPath = NULL;
 	
 	
@@ -832,8 +1354,8 @@ int main(int argc, char** argv){
 
             char* fileCompressionParameter = getStringValue(configArgs, "compression");
             if(fileCompressionParameter != NULL){
-                if(strcmp(fileCompressionParameter, "none") == 0){
-                    compressionAlgorithm = Uncompressed;
+                if(!parseCodec(fileCompressionParameter, &compressionAlgorithm, &compressionLevel)){
+                    fprintf(stderr, "Compression \"%s\" ignored: unknown codec or level out of range\n", fileCompressionParameter);
                 }
                 free(fileCompressionParameter);
             }
@@ -842,9 +1364,122 @@ int main(int argc, char** argv){
             if(cacheAlgorithmParameter != NULL){
                 if(strcmp(cacheAlgorithmParameter, "LRU") == 0){
                     cacheAlgorithm = LRU;
+                }else if(strcmp(cacheAlgorithmParameter, "ARC") == 0){
+                    cacheAlgorithm = ARC;
+                }else if(strcmp(cacheAlgorithmParameter, "GDSF") == 0){
+                    cacheAlgorithm = GDSF;
+                }else if(strcmp(cacheAlgorithmParameter, "CLOCK") == 0){
+                    cacheAlgorithm = CLOCK;
                 }
                 free(cacheAlgorithmParameter);
             }
+
+            char* evictionSinkParameter = getStringValue(configArgs, "evictionSink");
+            if(evictionSinkParameter != NULL){
+                if(strcmp(evictionSinkParameter, "discard") == 0){
+                    evictionSink = Discard;
+                }else if(strcmp(evictionSinkParameter, "spill") == 0){
+                    evictionSink = Spill;
+                }else if(strcmp(evictionSinkParameter, "tier") == 0){
+                    evictionSink = Tier;
+                }
+                free(evictionSinkParameter);
+            }
+            spillDirectory = getStringValue(configArgs, "spillDirectory");
+            if((evictionSink == Spill || evictionSink == Tier) && spillDirectory == NULL){
+                fprintf(stderr, "No string passed as \"spillDirectory\", needed to %s evicted files\n", evictionSink == Spill ? "spill" : "keep the disk tier of");
+                error = true;
+                free(socketPath);
+                free(logFilePath);
+                break;
+            }
+
+            highWatermark = getNodeForKey(configArgs, "highWatermark") != NULL ? getLongValue(configArgs, "highWatermark") : 0;
+            lowWatermark = getNodeForKey(configArgs, "lowWatermark") != NULL ? getLongValue(configArgs, "lowWatermark") : 0;
+            if(highWatermark != 0 || lowWatermark != 0){
+                if(lowWatermark < 0 || lowWatermark >= highWatermark || highWatermark > 100){
+                    fprintf(stderr, "\"lowWatermark\" and \"highWatermark\" have to be percentages, with \"lowWatermark\" lower than \"highWatermark\"\n");
+                    error = true;
+                    free(socketPath);
+                    free(logFilePath);
+                    free(spillDirectory);
+                    break;
+                }
+                if(evictionSink == ReturnToClient){
+                    //There's no client to return the files evicted in background to
+                    fprintf(stderr, "Watermarks ignored: evicted files are returned to clients, so they can only be evicted by requests\n");
+                }else{
+                    reclaimerEnabled = true;
+                }
+            }
+
+            if(getNodeForKey(configArgs, "cacheShards") != NULL){
+                cacheShards = getLongValue(configArgs, "cacheShards");
+                if(cacheShards < 1){
+                    fprintf(stderr, "\"cacheShards\" can't be less than 1\n");
+                    error = true;
+                    free(socketPath);
+                    free(logFilePath);
+                    free(spillDirectory);
+                    break;
+                }
+            }
+
+            if(getNodeForKey(configArgs, "compressionThreads") != NULL){
+                compressionThreads = getLongValue(configArgs, "compressionThreads");
+                if(compressionThreads < 1){
+                    fprintf(stderr, "\"compressionThreads\" can't be less than 1\n");
+                    error = true;
+                    free(socketPath);
+                    free(logFilePath);
+                    free(spillDirectory);
+                    break;
+                }
+            }
+
+            if(getNodeForKey(configArgs, "tieringInterval") != NULL){
+                tieringInterval = getLongValue(configArgs, "tieringInterval");
+                if(tieringInterval < 0){
+                    fprintf(stderr, "\"tieringInterval\" can't be negative\n");
+                    error = true;
+                    free(socketPath);
+                    free(logFilePath);
+                    free(spillDirectory);
+                    break;
+                }
+            }
+
+            char* hugePagesParameter = getStringValue(configArgs, "hugePages");
+            if(hugePagesParameter != NULL){
+                if(strcmp(hugePagesParameter, "true") == 0){
+                    hugePages = true;
+                }
+                free(hugePagesParameter);
+            }
+
+            char* deduplicationParameter = getStringValue(configArgs, "deduplication");
+            if(deduplicationParameter != NULL){
+                if(strcmp(deduplicationParameter, "true") == 0){
+                    deduplication = true;
+                }
+                free(deduplicationParameter);
+            }
+
+            char* compressionDictionaryParameter = getStringValue(configArgs, "compressionDictionary");
+            if(compressionDictionaryParameter != NULL){
+                if(strcmp(compressionDictionaryParameter, "true") == 0){
+                    compressionDictionary = true;
+                }
+                free(compressionDictionaryParameter);
+            }
+
+            char* admissionFilterParameter = getStringValue(configArgs, "admissionFilter");
+            if(admissionFilterParameter != NULL){
+                if(strcmp(admissionFilterParameter, "TinyLFU") == 0){
+                    admissionFilter = true;
+                }
+                free(admissionFilterParameter);
+            }
 			
 			char* logTimeFormattedParameter = getStringValue(configArgs, "logTimeFormat");
 			if(logTimeFormattedParameter != NULL){
@@ -858,36 +1493,20 @@ int main(int argc, char** argv){
 				free(logTimeFormattedParameter);
 			}
 			
-			char* endptr = NULL;
-			storageSize = strtoul(storageString, &endptr, 10);
-			switch(*endptr){
-				case 'k':
-				case 'K':{
-					storageSize *= 1024;
-					break;
-				}
-			case 'm':
-				case 'M':{
-					storageSize *= 1024 * 1024;
-					break;
-				}
-				case 'g':
-				case 'G':{
-					storageSize *= 1024 * 1024 * 1024;
-					break;
-				}
-				case 'b':
-				case 'B':
-				default:{
-					break;
-				}
-			}
-
+			storageSize = parseSize(storageString);
 			if(storageSize < 1){
 			    fprintf(stderr, "\"storageSize\" can't be less than 1\n");
 			    error = true;
 			    break;
 			}
+
+			//The disk tier holds four times as much as the memory unless told otherwise
+			tierSize = storageSize * 4;
+			char* tierSizeParameter = getStringValue(configArgs, "tierSize");
+			if(tierSizeParameter != NULL){
+			    tierSize = parseSize(tierSizeParameter);
+			    free(tierSizeParameter);
+			}
 		}while(false);
 		free(storageString);
 		freeArgsListNode(configArgs);
@@ -898,7 +1517,22 @@ int main(int argc, char** argv){
 	}
 	
 	
-	fileCache = initFileCache(maxFiles, storageSize, compressionAlgorithm, cacheAlgorithm);
+	if(reclaimerEnabled){
+	    highWatermarkSize = storageSize / 100 * highWatermark;
+	    highWatermarkFiles = maxFiles * highWatermark / 100;
+	    lowWatermarkSize = storageSize / 100 * lowWatermark;
+	    lowWatermarkFiles = maxFiles * lowWatermark / 100;
+	}
+	fileCache = initFileCache(maxFiles, storageSize, compressionAlgorithm, compressionLevel, cacheAlgorithm, admissionFilter, cacheShards, nWorkers + compressionThreads, hugePages, deduplication, compressionDictionary);
+	if(evictionSink == Tier){
+		diskTier = initDiskTier(spillDirectory, tierSize);
+		if(diskTier == NULL){
+			fprintf(stderr, "Error while initializing the disk tier in \"%s\"\n", spillDirectory);
+			freeFileCache(&fileCache);
+			cleanup();
+			return -1;
+		}
+	}
 	
 	//Creating server listen socket
 	int serverSocketDescriptor = -1;
@@ -975,13 +1609,61 @@ int main(int argc, char** argv){
 	}
 	
 	
+	//Spawn the compression pool, whose threads are the epoch participants after the workers
+	firstCompressorParticipant = nWorkers;
+	//One block of an upload being compressed by each thread of the pool, and one queued for the first thread that's free
+	maxPendingBlocks = compressionThreads + 1;
+	pthread_t compressors[compressionThreads];
+	for(long i = 0; i < compressionThreads; i++){
+		if(pthread_create(&(compressors[i]), NULL, compressorThread, (void*)i)){
+			perror("Error while creating compressor thread");
+			return -1;
+		}
+	}
+	//Spawn tiering thread, there's nothing to tier if the files aren't compressed
+	pthread_t tieringThreadID;
+	if(compressionAlgorithm == Uncompressed){
+		tieringInterval = 0;
+	}
+	if(tieringInterval > 0 && pthread_create(&tieringThreadID, NULL, tieringThread, NULL)){
+		perror("Error while creating tiering thread");
+		return -1;
+	}
+	//Spawn reclaimer thread
+	pthread_t reclaimerThreadID;
+	if(reclaimerEnabled && pthread_create(&reclaimerThreadID, NULL, reclaimerThread, NULL)){
+		perror("Error while creating reclaimer thread");
+		return -1;
+	}
+	
+	
 	//Main loop
     serverLog("[Master]: Server successfully started with the following parameters:\n");
     serverLog("[Master]: Number of workers: %d\n", nWorkers);
     serverLog("[Master]: Capacity: %d files, %d bytes\n", maxFiles, storageSize);
     serverLog("[Master]: Listening socket path: %s\n", socketPath);
-    serverLog("[Master]: Compression algorithm: %s\n", compressionAlgorithm == Miniz ? "zlib" : "none");
-    serverLog("[Master]: Caching algorithm: %s\n", cacheAlgorithm == FIFO ? "FIFO" : "LRU");
+    if(compressionAlgorithm == Uncompressed){
+        serverLog("[Master]: Compression algorithm: none\n");
+    }else{
+        serverLog("[Master]: Compression algorithm: %s, level %d\n", getCodec(compressionAlgorithm)->name, compressionLevel);
+    }
+    serverLog("[Master]: Compression threads: %ld\n", compressionThreads);
+    serverLog("[Master]: Preset dictionary for small files: %s\n", fileCache->dictionaries != NULL ? "yes" : "no");
+    if(tieringInterval > 0){
+        serverLog("[Master]: Tiering interval: %ld seconds\n", tieringInterval);
+    }
+    serverLog("[Master]: Caching algorithm: %s\n", getCacheAlgorithmName(cacheAlgorithm));
+    serverLog("[Master]: File cache shards: %u\n", fileCache->shardCount);
+    serverLog("[Master]: Admission filter: %s\n", admissionFilter ? "TinyLFU" : "none");
+    serverLog("[Master]: Huge pages for large files: %s\n", hugePages ? "yes" : "no");
+    serverLog("[Master]: Deduplication: %s\n", deduplication ? "yes" : "no");
+    serverLog("[Master]: Eviction sink: %s\n", evictionSink == Discard ? "discard" : (evictionSink == Spill ? "spill" : (evictionSink == Tier ? "tier" : "client")));
+    if(diskTier != NULL){
+        serverLog("[Master]: Disk tier: %lu bytes in \"%s\", segments of %lu bytes\n", tierSize, spillDirectory, diskTier->segmentSize);
+    }
+    if(reclaimerEnabled){
+        serverLog("[Master]: Watermarks: high %ld%%, low %ld%%\n", highWatermark, lowWatermark);
+    }
 	int maxFd = -1;
 	fd_set selectFdSet;
 	fd_set tempFdSet;
@@ -1028,6 +1710,13 @@ int main(int argc, char** argv){
 	
 	
 	//Cleanup
+	if(reclaimerEnabled){
+		pthread_mutex_lock_error(&reclaimerLock, "Error while locking reclaimer");
+		reclaimerShouldTerminate = true;
+		pthread_cond_signal_error(&reclaimerCond, "Error while waking reclaimer up");
+		pthread_mutex_unlock_error(&reclaimerLock, "Error while unlocking reclaimer");
+		pthread_join_error(reclaimerThreadID, "Error while joining on reclaimer thread");
+	}
 	freeClientList(&clientList);
 	
 	//It's safe to join on the signal handler, as the only way to terminate the server is for a signal to happen
@@ -1037,13 +1726,58 @@ int main(int argc, char** argv){
 	for(size_t i = 0; i < nWorkers; i++){
 		pthread_join_error(workers[i], "Error while joining worker thread");
 	}
+	//The tiering thread requests compressions too, so it's stopped before the compression pool
+	if(tieringInterval > 0){
+		pthread_mutex_lock_error(&tieringLock, "Error while locking tiering");
+		tieringShouldTerminate = true;
+		pthread_cond_signal_error(&tieringCond, "Error while waking tiering thread up");
+		pthread_mutex_unlock_error(&tieringLock, "Error while unlocking tiering");
+		pthread_join_error(tieringThreadID, "Error while joining on tiering thread");
+	}
+	//The compression pool is stopped after the workers, which can still request compressions until they terminate.
+	//Files still queued are left uncompressed
+	pthread_mutex_lock_error(&compressorsLock, "Error while locking compressors");
+	compressorsShouldTerminate = true;
+	pthread_cond_broadcast_error(&compressorsCond, "Error while waking compressors up");
+	pthread_mutex_unlock_error(&compressorsLock, "Error while unlocking compressors");
+	for(long i = 0; i < compressionThreads; i++){
+		pthread_join_error(compressors[i], "Error while joining on compressor thread");
+	}
+	while(!queueIsEmpty(filesToCompress)){
+		free(queuePop(&filesToCompress));
+	}
 
 
 	//Print stats
     serverLog("[Master]: Max storage size reached: %lu bytes\n", fileCache->maxReached.size);
     serverLog("[Master]: Max number of files stored: %u\n", fileCache->maxReached.fileNumber);
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) == 0){
+        serverLog("[Master]: Max resident memory: %ld KB\n", usage.ru_maxrss);
+    }
+    serverLog("[Master]: Memory reserved for file contents: %lu bytes, for %lu bytes stored\n", contentAllocatorReservedBytes(fileCache->contentAllocator), fileCache->current.size);
     serverLog("[Master]: Max number of clients simultaneously connected: %u\n", clientsConnectedMax);
     serverLog("[Master]: Number of files evicted: %u\n", fileCache->filesEvicted);
+    if(fileCache->admissionSketch != NULL){
+        serverLog("[Master]: Number of new files refused by the admission filter: %u\n", fileCache->filesRejected);
+    }
+    if(compressionAlgorithm != Uncompressed){
+        CompressionStatistics* compressionStats = &(fileCache->compressionStats);
+        serverLog("[Master]: Segments compressed: %u, not shrunk by compression: %u\n", compressionStats->compressed, compressionStats->notShrunk);
+        serverLog("[Master]: Segments not compressed: %u in a compressed format, %u with high entropy\n", compressionStats->skippedByFormat, compressionStats->skippedByEntropy);
+        serverLog("[Master]: Segments received compressed from the clients: %u\n", compressionStats->receivedCompressed);
+        if(fileCache->dictionaries != NULL){
+            serverLog("[Master]: Dictionaries trained: %u, segments compressed with a dictionary: %u\n", fileCache->dictionaries->trained, compressionStats->compressedWithDictionary);
+        }
+    }
+    if(fileCache->blobs != NULL){
+        serverLog("[Master]: Segments shared by deduplication: %u, bytes saved: %lu\n", fileCache->blobs->hits, fileCache->logicalSize - fileCache->current.size);
+    }
+    if(diskTier != NULL){
+        DiskTierStatistics* tierStats = &(diskTier->stats);
+        serverLog("[Master]: Files moved to the disk tier: %u, restored from it: %u, dropped from it: %u\n", tierStats->filesWritten, tierStats->filesPromoted, tierStats->filesDropped);
+        serverLog("[Master]: Disk tier: %lu bytes written, %lu bytes read, %u segments reclaimed, %lu bytes used\n", tierStats->bytesWritten, tierStats->bytesRead, tierStats->segmentsReclaimed, diskTier->size);
+    }
 
     for(size_t i = 0; i < nWorkers; i++){
         serverLog("[Master]: Worker #%u has served %u requests\n", i, requestsServed[i]);
@@ -1052,13 +1786,15 @@ int main(int argc, char** argv){
 
     //Print list of files in the server
     serverLog("[Master]: Files contained in the server:\n");
-    FileList* current = fileCache->files;
-    while(current != NULL){
-        size_t fileSize = getUncompressedSize(current->file);
-        if(fileSize > 0){ //Don't show empty files
-            serverLog("[Master]: \"%s\", %d bytes\n", current->file->filename, fileSize);
+    for(unsigned int i = 0; i < fileCache->shardCount; i++){
+        FileList* current = fileCache->shards[i].files;
+        while(current != NULL){
+            size_t fileSize = getUncompressedSize(current->file);
+            if(fileSize > 0){ //Don't show empty files
+                serverLog("[Master]: \"%s\", %d bytes\n", current->file->filename, fileSize);
+            }
+            current = current->next;
         }
-        current = current->next;
     }
 
 	//Send termination message and join on the log server
@@ -1078,6 +1814,7 @@ int main(int argc, char** argv){
 		perror("Error while closing log pipe write endpoint");
 	}
 	
+	freeDiskTier(&diskTier);
 	freeFileCache(&fileCache);
 	cleanup();
 	return 0;
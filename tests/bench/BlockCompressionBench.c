@@ -0,0 +1,158 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../src/include/FileCache.h"
+#include "../../src/include/TimespecUtils.h"
+
+#define FILE_SIZE (32 * 1024 * 1024)
+#define RANGE_SIZE 4096 //Bytes read from the middle of the file by the random access measure
+#define MAX_THREADS 16
+
+
+
+typedef struct UploadWork{
+    FileCache* fileCache;
+    FileContents* upload;
+    const char* data;
+    unsigned int blockCount;
+    unsigned int nextBlock; //Taken atomically by the compressors
+    bool failed;
+} UploadWork;
+
+static double now(){
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return timespecToDouble(time);
+}
+
+static bool discardOutput(const char* chunk, size_t size, void* argument){
+    return true;
+}
+
+//Stores the blocks of an upload as the compression pool of the server does, each thread taking the next block still to be compressed
+static void* compressBlocks(void* argument){
+    UploadWork* work = argument;
+    unsigned int index;
+    while((index = __atomic_fetch_add(&(work->nextBlock), 1, __ATOMIC_RELAXED)) < work->blockCount){
+        size_t offset = (size_t)index * FILE_UPLOAD_CHUNK_SIZE;
+        size_t size = FILE_SIZE - offset < FILE_UPLOAD_CHUNK_SIZE ? FILE_SIZE - offset : FILE_UPLOAD_CHUNK_SIZE;
+        char* block = allocateFileData(work->fileCache, size);
+        if(block == NULL){
+            work->failed = true;
+            break;
+        }
+        memcpy(block, work->data + offset, size);
+        if(!uploadFileChunk(work->fileCache, work->upload, index, block, size)){
+            work->failed = true;
+        }
+    }
+    return NULL;
+}
+
+//Time taken to read RANGE_SIZE bytes from the middle of a file
+static double measureRangeRead(FileCache* fileCache, CachedFile* file){
+    pthread_mutex_lock(&(file->lock));
+    FileContents* contents = pinFileContents(fileCache, file);
+    pthread_mutex_unlock(&(file->lock));
+    double start = now();
+    bool read = streamFileRange(contents, FILE_SIZE / 2, RANGE_SIZE, discardOutput, NULL);
+    double elapsed = now() - start;
+    unpinFileContents(contents);
+    return read ? elapsed : -1;
+}
+
+static FileCache* initBenchCache(unsigned int readers){
+    FileCache* fileCache = initFileCache(1, 2UL * FILE_SIZE, Miniz, getCodec(Miniz)->defaultLevel, FIFO, false, 1, readers, false, false, false);
+    if(fileCache == NULL){
+        exit(EXIT_FAILURE);
+    }
+    return fileCache;
+}
+
+//Stores the file in a single segment and compresses it with compressFile, as every file was before the blocks were introduced
+static void measureWholeFile(const char* data){
+    FileCache* fileCache = initBenchCache(0);
+    CachedFile* file = createFile(fileCache, "/bench/file");
+    double start = now();
+    char* buffer = allocateFileData(fileCache, FILE_SIZE);
+    memcpy(buffer, data, FILE_SIZE);
+    pthread_mutex_lock(&(file->lock));
+    storeFile(fileCache, file, buffer, FILE_SIZE);
+    pthread_mutex_unlock(&(file->lock));
+    compressFile(fileCache, file);
+    double elapsed = now() - start;
+    printf("%-12s %8.0f ms %7.1f%% %11.2f ms\n", "whole file", elapsed * 1e3, 100.0 * getFileSize(file) / FILE_SIZE, measureRangeRead(fileCache, file) * 1e3);
+    freeFileCache(&fileCache);
+}
+
+static void measureBlocks(const char* data, unsigned int threadCount){
+    FileCache* fileCache = initBenchCache(threadCount);
+    UploadWork work = {fileCache, NULL, data, (FILE_SIZE + FILE_UPLOAD_CHUNK_SIZE - 1) / FILE_UPLOAD_CHUNK_SIZE, 0, false};
+    pthread_t threads[MAX_THREADS];
+    double start = now();
+    work.upload = beginFileUpload(FILE_SIZE);
+    for(unsigned int i = 0; i < threadCount; i++){
+        if(pthread_create(&(threads[i]), NULL, compressBlocks, &work)){
+            perror("Error while creating compressor");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for(unsigned int i = 0; i < threadCount; i++){
+        pthread_join(threads[i], NULL);
+    }
+    CachedFile* file = createFile(fileCache, "/bench/file");
+    pthread_mutex_lock(&(file->lock));
+    size_t size = work.failed ? 0 : storeFileUpload(fileCache, file, work.upload, false);
+    pthread_mutex_unlock(&(file->lock));
+    double elapsed = now() - start;
+    if(size == 0){
+        fprintf(stderr, "Error while storing the blocks\n");
+        exit(EXIT_FAILURE);
+    }
+    printf("%2u %-9s %8.0f ms %7.1f%% %11.2f ms\n", threadCount, threadCount == 1 ? "thread" : "threads", elapsed * 1e3, 100.0 * size / FILE_SIZE, measureRangeRead(fileCache, file) * 1e3);
+    freeFileCache(&fileCache);
+}
+
+
+
+//Time to compress and store a large file, in a single segment and in blocks compressed by a growing number of threads, and
+//time to read a small range from the middle of it, built from the files passed as arguments (user-023)
+int main(int argc, char* argv[]){
+    if(argc < 2){
+        fprintf(stderr, "Usage: %s file...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    char* data = malloc(FILE_SIZE);
+    size_t filled = 0;
+    while(filled < FILE_SIZE){
+        size_t before = filled;
+        for(int i = 1; i < argc && filled < FILE_SIZE; i++){
+            FILE* stream = fopen(argv[i], "rb");
+            if(stream == NULL){
+                perror(argv[i]);
+                return EXIT_FAILURE;
+            }
+            filled += fread(data + filled, 1, FILE_SIZE - filled, stream);
+            fclose(stream);
+        }
+        if(filled == before){
+            fprintf(stderr, "The files are empty\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    unsigned int threadCounts[] = {1, 2, 4, 8, 16};
+    printf("Compression of a %d MB file with %s, blocks of %d bytes, %ld online CPUs\n", FILE_SIZE / (1024 * 1024), getCodec(Miniz)->name, FILE_UPLOAD_CHUNK_SIZE, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-12s %11s %8s %14s\n", "", "stored in", "size", "4K range read");
+    measureWholeFile(data);
+    for(unsigned int i = 0; i < sizeof(threadCounts) / sizeof(threadCounts[0]); i++){
+        measureBlocks(data, threadCounts[i]);
+    }
+    printf("\n");
+    free(data);
+    return 0;
+}
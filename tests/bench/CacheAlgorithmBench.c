@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../../src/include/FileCache.h"
+
+#define CACHE_FILES 100
+#define HOT_FILES 60
+#define HOT_ACCESSES 600 //Reads of the hot set between two scans
+#define PHASES 50
+
+
+
+typedef struct TraceResult{
+    unsigned int hits;
+    unsigned int accesses;
+    unsigned int hotHits; //Hits on the hot set, in the phases after the first one
+    unsigned int hotAccesses;
+} TraceResult;
+
+//Opens a file the way the server does: a read if it's cached, otherwise it's created, evicting a file if the cache is full
+//and the admission filter lets it in. Returns whether the file was cached
+static bool accessFile(FileCache* fileCache, const char* filename){
+    recordFileAccess(fileCache, filename);
+    CachedFile* file = getFile(fileCache, filename);
+    if(file != NULL){
+        pthread_mutex_lock(&(file->lock));
+        FileContents* contents = pinFileContents(fileCache, file);
+        pthread_mutex_unlock(&(file->lock));
+        unpinFileContents(contents);
+        return true;
+    }
+    if(!canFitNewFile(fileCache)){
+        if(!admitFile(fileCache, filename)){
+            return false;
+        }
+        FileList* victims = detachFilesToEvict(fileCache, NULL, 0, 1);
+        freeFileList(&victims);
+    }
+    if(canFitNewFile(fileCache)){
+        createFile(fileCache, filename);
+    }
+    return false;
+}
+
+//Replays a trace of a hot set read over and over, interrupted by scans of files that are never read again, as written by
+//a bulk upload. Each scan is scanLength files long
+static TraceResult replayTrace(CacheAlgorithm algorithm, bool admissionFilter, unsigned int scanLength){
+    TraceResult result = {0, 0, 0, 0};
+    FileCache* fileCache = initFileCache(CACHE_FILES, 1UL << 30, Uncompressed, 0, algorithm, admissionFilter, 1, 0, false, false, false);
+    if(fileCache == NULL){
+        exit(EXIT_FAILURE);
+    }
+    char filename[MAX_FILENAME_SIZE];
+    unsigned int scanned = 0;
+    srand(1);
+    for(unsigned int phase = 0; phase < PHASES; phase++){
+        for(unsigned int i = 0; i < HOT_ACCESSES; i++){
+            snprintf(filename, MAX_FILENAME_SIZE, "/hot/file-%d", rand() % HOT_FILES);
+            bool hit = accessFile(fileCache, filename);
+            result.hits += hit;
+            result.accesses++;
+            if(phase > 0){
+                result.hotHits += hit;
+                result.hotAccesses++;
+            }
+        }
+        for(unsigned int i = 0; i < scanLength; i++){
+            snprintf(filename, MAX_FILENAME_SIZE, "/scan/file-%u", scanned++);
+            result.hits += accessFile(fileCache, filename);
+            result.accesses++;
+        }
+    }
+    freeFileCache(&fileCache);
+    return result;
+}
+
+
+
+//Hit ratio of the caching algorithms on a scan-plus-hot-set trace (user-003)
+int main(){
+    CacheAlgorithm algorithms[] = {FIFO, LRU, ARC, GDSF, CLOCK};
+    unsigned int scanLengths[] = {50, 150, 400};
+    printf("Hit ratio on a scan-plus-hot-set trace: %d cached files, %d hot files read %d times between scans, %d phases\n", CACHE_FILES, HOT_FILES, HOT_ACCESSES, PHASES);
+    printf("Hits on all the accesses / on the hot set after the first scan, by the length of the scans\n");
+    printf("%-14s", "algorithm");
+    for(unsigned int s = 0; s < sizeof(scanLengths) / sizeof(scanLengths[0]); s++){
+        printf("%14s%-5u", "scan ", scanLengths[s]);
+    }
+    printf("\n");
+    for(unsigned int a = 0; a < 2 * sizeof(algorithms) / sizeof(algorithms[0]); a++){
+        CacheAlgorithm algorithm = algorithms[a / 2];
+        bool admissionFilter = a % 2;
+        printf("%-5s%-9s", getCacheAlgorithmName(algorithm), admissionFilter ? "+filter" : "");
+        for(unsigned int s = 0; s < sizeof(scanLengths) / sizeof(scanLengths[0]); s++){
+            TraceResult result = replayTrace(algorithm, admissionFilter, scanLengths[s]);
+            printf("   %6.1f%% /%6.1f%%", 100.0 * result.hits / result.accesses, 100.0 * result.hotHits / result.hotAccesses);
+        }
+        printf("\n");
+    }
+    printf("\n");
+    return 0;
+}
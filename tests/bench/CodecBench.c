@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../src/include/Codec.h"
+#include "../../src/include/TimespecUtils.h"
+
+#define MIN_MEASURED_TIME 0.5 //Seconds each measure is repeated for at least
+
+
+
+typedef struct CorpusFile{
+    char* data;
+    size_t size;
+    char* compressed;
+    size_t compressedSize;
+    char* decompressed;
+} CorpusFile;
+
+static double now(){
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return timespecToDouble(time);
+}
+
+static bool readCorpusFile(const char* path, CorpusFile* file){
+    FILE* stream = fopen(path, "rb");
+    if(stream == NULL){
+        perror(path);
+        return false;
+    }
+    fseek(stream, 0, SEEK_END);
+    file->size = ftell(stream);
+    rewind(stream);
+    file->data = malloc(file->size > 0 ? file->size : 1);
+    bool read = file->data != NULL && fread(file->data, 1, file->size, stream) == file->size;
+    fclose(stream);
+    return read;
+}
+
+//Compresses and decompresses the whole corpus with a codec, printing the ratio and the speeds, measured on the uncompressed size
+static bool measureCodec(const Codec* codec, int level, CorpusFile* corpus, unsigned int fileCount){
+    size_t totalSize = 0;
+    size_t totalCompressedSize = 0;
+    for(unsigned int i = 0; i < fileCount; i++){
+        corpus[i].compressed = malloc(codec->bound(corpus[i].size));
+        corpus[i].decompressed = malloc(corpus[i].size > 0 ? corpus[i].size : 1);
+    }
+
+    unsigned int rounds = 0;
+    double start = now();
+    do{
+        for(unsigned int i = 0; i < fileCount; i++){
+            corpus[i].compressedSize = codec->compress(corpus[i].data, corpus[i].size, corpus[i].compressed, codec->bound(corpus[i].size), level);
+        }
+        rounds++;
+    }while(now() - start < MIN_MEASURED_TIME);
+    double compressionTime = (now() - start) / rounds;
+
+    bool valid = true;
+    rounds = 0;
+    start = now();
+    do{
+        for(unsigned int i = 0; i < fileCount; i++){
+            valid = valid && codec->decompress(corpus[i].compressed, corpus[i].compressedSize, corpus[i].decompressed, corpus[i].size);
+        }
+        rounds++;
+    }while(now() - start < MIN_MEASURED_TIME);
+    double decompressionTime = (now() - start) / rounds;
+
+    for(unsigned int i = 0; i < fileCount; i++){
+        valid = valid && corpus[i].compressedSize > 0 && memcmp(corpus[i].data, corpus[i].decompressed, corpus[i].size) == 0;
+        totalSize += corpus[i].size;
+        totalCompressedSize += corpus[i].compressedSize;
+        free(corpus[i].compressed);
+        free(corpus[i].decompressed);
+    }
+    printf("%-6s %5d %8.1f%% %12.1f MB/s %12.1f MB/s%s\n", codec->name, level, 100.0 * totalCompressedSize / totalSize, totalSize / compressionTime / 1e6, totalSize / decompressionTime / 1e6, valid ? "" : "  (round trip failed)");
+    return valid;
+}
+
+
+
+//Ratio and speed of the codecs of the registry at their lowest, default and highest levels, on the files passed as arguments (user-017)
+int main(int argc, char* argv[]){
+    if(argc < 2){
+        fprintf(stderr, "Usage: %s file...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    unsigned int fileCount = argc - 1;
+    CorpusFile* corpus = calloc(fileCount, sizeof(CorpusFile));
+    size_t totalSize = 0;
+    for(unsigned int i = 0; i < fileCount; i++){
+        if(!readCorpusFile(argv[i + 1], &(corpus[i]))){
+            return EXIT_FAILURE;
+        }
+        totalSize += corpus[i].size;
+    }
+
+    bool valid = true;
+    printf("Codec comparison on %u files, %zu bytes, each file compressed on its own\n", fileCount, totalSize);
+    printf("%-6s %5s %9s %17s %17s\n", "codec", "level", "size", "compression", "decompression");
+    for(CompressionAlgorithm algorithm = Miniz; algorithm < CompressionAlgorithmCount; algorithm++){
+        const Codec* codec = getCodec(algorithm);
+        //Level 0 of zlib stores the data as it is
+        int levels[] = {codec->minLevel > 0 ? codec->minLevel : 1, codec->defaultLevel, codec->maxLevel};
+        for(unsigned int l = 0; l < sizeof(levels) / sizeof(levels[0]); l++){
+            if(l == 0 || levels[l] != levels[l - 1]){
+                valid = measureCodec(codec, levels[l], corpus, fileCount) && valid;
+            }
+        }
+    }
+    printf("\n");
+
+    for(unsigned int i = 0; i < fileCount; i++){
+        free(corpus[i].data);
+    }
+    free(corpus);
+    return valid ? 0 : EXIT_FAILURE;
+}
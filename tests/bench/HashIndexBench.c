@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../../src/include/FileCache.h"
+#include "../../src/include/TimespecUtils.h"
+
+#define LOOKUPS 1000000
+#define LINEAR_SCAN_BUDGET 100000000 //Nodes the linear scan is allowed to visit, at each size
+
+
+
+static double now(){
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return timespecToDouble(time);
+}
+
+//Looks a file up the way getFile did before the index, walking the lists of the files comparing their names
+static CachedFile* linearScan(FileCache* fileCache, const char* filename){
+    for(unsigned int i = 0; i < fileCache->shardCount; i++){
+        for(FileList* node = fileCache->shards[i].files; node != NULL; node = node->next){
+            if(strncmp(node->file->filename, filename, MAX_FILENAME_SIZE) == 0){
+                return node->file;
+            }
+        }
+    }
+    return NULL;
+}
+
+//Average latency, in nanoseconds, of lookups of random existing files, with the names already built
+static double measureLookups(FileCache* fileCache, char** names, unsigned int fileCount, unsigned int lookups, bool linear){
+    unsigned int* picks = malloc(lookups * sizeof(unsigned int));
+    for(unsigned int i = 0; i < lookups; i++){
+        picks[i] = rand() % fileCount;
+    }
+    unsigned int found = 0;
+    double start = now();
+    for(unsigned int i = 0; i < lookups; i++){
+        found += (linear ? linearScan(fileCache, names[picks[i]]) : getFile(fileCache, names[picks[i]])) != NULL;
+    }
+    double elapsed = now() - start;
+    free(picks);
+    if(found != lookups){
+        fprintf(stderr, "Only %u of %u lookups found their file\n", found, lookups);
+    }
+    return elapsed * 1e9 / lookups;
+}
+
+
+
+//Lookup latency of the file index against the linear scan of the file list it replaced (user-001)
+int main(){
+    unsigned int sizes[] = {100, 10000, 1000000};
+    srand(1);
+    printf("File index lookup latency, random existing files\n");
+    printf("%10s %16s %16s\n", "files", "linear scan", "hash index");
+    for(unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++){
+        unsigned int fileCount = sizes[s];
+        FileCache* fileCache = initFileCache(fileCount, 1UL << 40, Uncompressed, 0, FIFO, false, FILE_CACHE_DEFAULT_SHARDS, 0, false, false, false);
+        if(fileCache == NULL){
+            return EXIT_FAILURE;
+        }
+        char** names = malloc(fileCount * sizeof(char*));
+        for(unsigned int i = 0; i < fileCount; i++){
+            names[i] = malloc(MAX_FILENAME_SIZE);
+            snprintf(names[i], MAX_FILENAME_SIZE, "/home/user/documents/bench/file-%u.txt", i);
+            if(createFile(fileCache, names[i]) == NULL){
+                fprintf(stderr, "Error while creating file %s\n", names[i]);
+                return EXIT_FAILURE;
+            }
+        }
+
+        unsigned int linearLookups = LINEAR_SCAN_BUDGET / fileCount < LOOKUPS ? LINEAR_SCAN_BUDGET / fileCount : LOOKUPS;
+        double linear = measureLookups(fileCache, names, fileCount, linearLookups, true);
+        double indexed = measureLookups(fileCache, names, fileCount, LOOKUPS, false);
+        printf("%10u %13.0f ns %13.0f ns\n", fileCount, linear, indexed);
+
+        for(unsigned int i = 0; i < fileCount; i++){
+            free(names[i]);
+        }
+        free(names);
+        freeFileCache(&fileCache);
+    }
+    printf("\n");
+    return 0;
+}
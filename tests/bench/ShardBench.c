@@ -0,0 +1,109 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../src/include/FileCache.h"
+#include "../../src/include/TimespecUtils.h"
+
+#define FILES 10000
+#define OPERATIONS 1000000 //Split among the workers
+#define WRITE_PERCENT 10
+#define MAX_WORKERS 16
+
+
+
+typedef struct Worker{
+    pthread_t thread;
+    unsigned int id;
+    unsigned int operations;
+    FileCache* fileCache;
+} Worker;
+
+static char names[FILES][MAX_FILENAME_SIZE];
+
+static double now(){
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return timespecToDouble(time);
+}
+
+//Serves requests the way a worker of the server does: most of them read a cached file, the others create a file and remove it,
+//which needs the lock of its shard for writing
+static void* runWorker(void* argument){
+    Worker* worker = argument;
+    FileCache* fileCache = worker->fileCache;
+    unsigned int seed = worker->id + 1;
+    char filename[MAX_FILENAME_SIZE];
+    for(unsigned int i = 0; i < worker->operations; i++){
+        epochEnter(fileCache->epoch, worker->id);
+        if(rand_r(&seed) % 100 < WRITE_PERCENT){
+            snprintf(filename, MAX_FILENAME_SIZE, "/bench/worker-%u/file-%u", worker->id, i);
+            if(createFile(fileCache, filename) != NULL){
+                removeFileFromCache(fileCache, filename);
+            }
+        }else{
+            CachedFile* file = getFile(fileCache, names[rand_r(&seed) % FILES]);
+            if(file != NULL){
+                pthread_mutex_lock(&(file->lock));
+                FileContents* contents = pinFileContents(fileCache, file);
+                pthread_mutex_unlock(&(file->lock));
+                unpinFileContents(contents);
+            }
+        }
+        epochExit(fileCache->epoch, worker->id);
+    }
+    return NULL;
+}
+
+//Requests served per second by workerCount workers sharing a cache split in shardCount shards
+static double measureThroughput(CacheAlgorithm algorithm, unsigned int shardCount, unsigned int workerCount){
+    FileCache* fileCache = initFileCache(FILES + MAX_WORKERS, 1UL << 30, Uncompressed, 0, algorithm, false, shardCount, workerCount, false, false, false);
+    if(fileCache == NULL){
+        exit(EXIT_FAILURE);
+    }
+    for(unsigned int i = 0; i < FILES; i++){
+        createFile(fileCache, names[i]);
+    }
+    Worker workers[MAX_WORKERS];
+    double start = now();
+    for(unsigned int i = 0; i < workerCount; i++){
+        workers[i].id = i;
+        workers[i].operations = OPERATIONS / workerCount;
+        workers[i].fileCache = fileCache;
+        if(pthread_create(&(workers[i].thread), NULL, runWorker, &(workers[i]))){
+            perror("Error while creating worker");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for(unsigned int i = 0; i < workerCount; i++){
+        pthread_join(workers[i].thread, NULL);
+    }
+    double elapsed = now() - start;
+    freeFileCache(&fileCache);
+    return (OPERATIONS / workerCount) * workerCount / elapsed;
+}
+
+
+
+//Throughput of the file cache as the workers grow, with a single shard, which behaves like the global lock it replaced, and
+//with the default number of shards (user-009)
+int main(){
+    unsigned int workerCounts[] = {1, 2, 4, 8, 16};
+    CacheAlgorithm algorithms[] = {FIFO, LRU};
+    for(unsigned int i = 0; i < FILES; i++){
+        snprintf(names[i], MAX_FILENAME_SIZE, "/bench/file-%u", i);
+    }
+    printf("File cache throughput, %d files, %d%% of the requests create and remove a file, %ld online CPUs\n", FILES, WRITE_PERCENT, sysconf(_SC_NPROCESSORS_ONLN));
+    for(unsigned int a = 0; a < sizeof(algorithms) / sizeof(algorithms[0]); a++){
+        printf("%-6s %8s %16s %9d shards\n", getCacheAlgorithmName(algorithms[a]), "workers", "1 shard", FILE_CACHE_DEFAULT_SHARDS);
+        for(unsigned int w = 0; w < sizeof(workerCounts) / sizeof(workerCounts[0]); w++){
+            double single = measureThroughput(algorithms[a], 1, workerCounts[w]);
+            double sharded = measureThroughput(algorithms[a], FILE_CACHE_DEFAULT_SHARDS, workerCounts[w]);
+            printf("%-6s %8u %10.2f Mop/s %10.2f Mop/s\n", "", workerCounts[w], single / 1e6, sharded / 1e6);
+        }
+    }
+    printf("\n");
+    return 0;
+}